@@ -14,7 +14,7 @@
  * on the local processor, one does not.
  *
  * These are fair FIFO ticket locks, which are currently limited to 256
- * CPUs.
+ * CPUs, or queued spinlocks with CONFIG_QUEUED_SPINLOCKS.
  *
  * (the type definitions are in asm/spinlock_types.h)
  */
@@ -38,6 +38,9 @@
 # define UNLOCK_LOCK_PREFIX
 #endif
 
+#ifdef CONFIG_QUEUED_SPINLOCKS
+#include <asm/qspinlock.h>
+#else
 /*
  * Ticket locks are conceptually two parts, one indicating the current head of
  * the queue, and the other indicating the current tail. The lock is acquired
@@ -165,6 +168,17 @@ static inline int __ticket_spin_is_locked(arch_spinlock_t *lock)
 	return !!(((tmp >> TICKET_SHIFT) ^ tmp) & ((1 << TICKET_SHIFT) - 1));
 }
 
+/*
+ * Tell whether a snapshot of a lock word, taken without touching the lock
+ * itself, was unlocked at the time.
+ */
+static inline int arch_spin_value_unlocked(arch_spinlock_t lock)
+{
+	int tmp = lock.slock;
+
+	return !(((tmp >> TICKET_SHIFT) ^ tmp) & ((1 << TICKET_SHIFT) - 1));
+}
+
 static inline int __ticket_spin_is_contended(arch_spinlock_t *lock)
 {
 	int tmp = ACCESS_ONCE(lock->slock);
@@ -214,6 +228,8 @@ static inline void arch_spin_unlock_wait(arch_spinlock_t *lock)
 		cpu_relax();
 }
 
+#endif	/* CONFIG_QUEUED_SPINLOCKS */
+
 /*
  * Read-write spinlocks, allowing multiple readers
  * but only one writer.
@@ -22,6 +22,7 @@
 #include <linux/interrupt.h>
 #include <linux/cpu.h>
 #include <linux/gfp.h>
+#include <linux/tick.h>
 
 #include <asm/mtrr.h>
 #include <asm/tlbflush.h>
@@ -205,6 +206,15 @@ void smp_reschedule_interrupt(struct pt_regs *regs)
 	/*
 	 * KVM uses this interrupt to force a cpu out of guest mode
 	 */
+
+	/*
+	 * Full dynticks cpus are also kicked with it when their tick must
+	 * come back, irq_exit() reevaluates it.
+	 */
+	if (tick_nohz_full_cpu(smp_processor_id())) {
+		irq_enter();
+		irq_exit();
+	}
 }
 
 void smp_call_function_interrupt(struct pt_regs *regs)
@@ -0,0 +1,90 @@
+/*
+ * CPU to hardware queue mapping for blk-mq
+ */
+#include <linux/kernel.h>
+#include <linux/threads.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/cpu.h>
+#include <linux/topology.h>
+#include <linux/blk-mq.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+static unsigned int cpu_to_queue_index(unsigned int nr_cpus,
+				       unsigned int nr_queues, const int cpu)
+{
+	return cpu * nr_queues / nr_cpus;
+}
+
+static int get_first_sibling(unsigned int cpu)
+{
+	unsigned int ret;
+
+	ret = cpumask_first(topology_thread_cpumask(cpu));
+	if (ret < nr_cpu_ids)
+		return ret;
+
+	return cpu;
+}
+
+/*
+ * Spread the possible CPUs evenly over @nr_queues. If there are fewer
+ * queues than CPUs, hyperthread siblings share the queue of their first
+ * sibling, since they share the caches as well.
+ */
+int blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues)
+{
+	unsigned int i, nr_cpus, nr_uniq_cpus, queue, first_sibling;
+
+	nr_cpus = nr_uniq_cpus = 0;
+	for_each_possible_cpu(i) {
+		nr_cpus++;
+		first_sibling = get_first_sibling(i);
+		if (first_sibling == i)
+			nr_uniq_cpus++;
+	}
+
+	queue = 0;
+	for_each_possible_cpu(i) {
+		/*
+		 * Easy case - we have equal or more hardware queues. Or
+		 * there are no thread siblings to take into account. Do
+		 * 1:1 if enough, or sequential mapping if less.
+		 */
+		if (nr_queues >= nr_cpus || nr_cpus == nr_uniq_cpus) {
+			map[i] = cpu_to_queue_index(nr_cpus, nr_queues, queue);
+			queue++;
+			continue;
+		}
+
+		first_sibling = get_first_sibling(i);
+		if (first_sibling == i) {
+			map[i] = cpu_to_queue_index(nr_uniq_cpus, nr_queues,
+						    queue);
+			queue++;
+		} else
+			map[i] = map[first_sibling];
+	}
+
+	return 0;
+}
+
+unsigned int *blk_mq_make_queue_map(struct blk_mq_reg *reg)
+{
+	unsigned int *map;
+
+	/* CPUs that are not possible are left mapped to the first hctx */
+	map = kzalloc_node(sizeof(*map) * nr_cpu_ids, GFP_KERNEL,
+			   reg->numa_node);
+	if (!map)
+		return NULL;
+
+	if (!blk_mq_update_queue_map(map, reg->nr_hw_queues))
+		return map;
+
+	kfree(map);
+	return NULL;
+}
@@ -0,0 +1,163 @@
+/*
+ * Tag allocation for blk-mq hardware queues
+ *
+ * Tags index the preallocated requests of a hardware queue. The first
+ * nr_reserved_tags entries are kept for reserved (internal) allocations,
+ * the rest are handed out for normal I/O. Allocation is a lockless scan of
+ * a bitmap, starting at a per-cpu hint so that CPUs tend to stay out of
+ * each other's cachelines.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+struct blk_mq_tags {
+	unsigned int nr_tags;
+	unsigned int nr_reserved_tags;
+
+	unsigned int __percpu *hint;
+	wait_queue_head_t wait;
+
+	unsigned long map[0];
+};
+
+static unsigned int __blk_mq_find_tag(struct blk_mq_tags *tags,
+				      unsigned int start, unsigned int end,
+				      unsigned int hint)
+{
+	unsigned int tag;
+
+	if (hint < start || hint >= end)
+		hint = start;
+
+	tag = hint;
+	do {
+		tag = find_next_zero_bit(tags->map, end, tag);
+		if (tag >= end) {
+			/* wrap around once, scanning up to the hint */
+			if (hint == start)
+				return BLK_MQ_TAG_FAIL;
+			tag = start;
+			end = hint;
+			hint = start;
+			continue;
+		}
+		if (!test_and_set_bit_lock(tag, tags->map))
+			return tag;
+	} while (1);
+}
+
+static unsigned int __blk_mq_get_tag(struct blk_mq_tags *tags, bool reserved)
+{
+	unsigned int tag;
+
+	if (reserved) {
+		if (!tags->nr_reserved_tags)
+			return BLK_MQ_TAG_FAIL;
+		return __blk_mq_find_tag(tags, 0, tags->nr_reserved_tags, 0);
+	}
+
+	tag = __blk_mq_find_tag(tags, tags->nr_reserved_tags, tags->nr_tags,
+				this_cpu_read(*tags->hint));
+	if (tag != BLK_MQ_TAG_FAIL)
+		this_cpu_write(*tags->hint, tag + 1);
+
+	return tag;
+}
+
+bool blk_mq_has_free_tags(struct blk_mq_tags *tags)
+{
+	return find_next_zero_bit(tags->map, tags->nr_tags,
+				  tags->nr_reserved_tags) < tags->nr_tags;
+}
+
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp, bool reserved)
+{
+	DEFINE_WAIT(wait);
+	unsigned int tag;
+
+	tag = __blk_mq_get_tag(tags, reserved);
+	if (tag != BLK_MQ_TAG_FAIL || !(gfp & __GFP_WAIT))
+		return tag;
+
+	do {
+		prepare_to_wait(&tags->wait, &wait, TASK_UNINTERRUPTIBLE);
+		tag = __blk_mq_get_tag(tags, reserved);
+		if (tag != BLK_MQ_TAG_FAIL)
+			break;
+		io_schedule();
+	} while (1);
+
+	finish_wait(&tags->wait, &wait);
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	BUG_ON(tag >= tags->nr_tags);
+
+	clear_bit_unlock(tag, tags->map);
+	if (tag >= tags->nr_reserved_tags)
+		this_cpu_write(*tags->hint, tag);
+
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int total_tags,
+				     unsigned int reserved_tags, int node)
+{
+	struct blk_mq_tags *tags;
+	size_t map_size;
+
+	if (total_tags > BLK_MQ_MAX_DEPTH) {
+		pr_err("blk-mq: tag depth too large\n");
+		return NULL;
+	}
+
+	map_size = BITS_TO_LONGS(total_tags) * sizeof(unsigned long);
+	tags = kzalloc_node(sizeof(*tags) + map_size, GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->hint = alloc_percpu(unsigned int);
+	if (!tags->hint) {
+		kfree(tags);
+		return NULL;
+	}
+
+	tags->nr_tags = total_tags;
+	tags->nr_reserved_tags = reserved_tags;
+	init_waitqueue_head(&tags->wait);
+	return tags;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	if (!tags)
+		return;
+
+	free_percpu(tags->hint);
+	kfree(tags);
+}
+
+ssize_t blk_mq_tag_sysfs_show(struct blk_mq_tags *tags, char *page)
+{
+	unsigned int used;
+
+	if (!tags)
+		return 0;
+
+	used = bitmap_weight(tags->map, tags->nr_tags);
+	return sprintf(page, "nr_tags=%u, reserved_tags=%u, used=%u\n",
+		       tags->nr_tags, tags->nr_reserved_tags, used);
+}
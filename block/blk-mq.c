@@ -0,0 +1,1226 @@
+/*
+ * Block multiqueue core code
+ *
+ * Requests are submitted into a per-cpu software queue (struct blk_mq_ctx)
+ * and dispatched to the driver through one of the hardware queues
+ * (struct blk_mq_hw_ctx) the software queue maps to. Requests are
+ * preallocated per hardware queue and identified by their tag, so the
+ * submission path never touches a queue wide lock.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/backing-dev.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/mm.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/smp.h>
+#include <linux/cpu.h>
+#include <linux/cache.h>
+#include <linux/sched.h>
+#include <linux/elevator.h>
+#include <linux/completion.h>
+#include <linux/blk-mq.h>
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+static struct blk_mq_ctx *__blk_mq_get_ctx(struct request_queue *q,
+					   unsigned int cpu)
+{
+	return per_cpu_ptr(q->queue_ctx, cpu);
+}
+
+/*
+ * This assumes per-cpu software queueing queues. They could be per-node
+ * as well, for instance. For now this is hardcoded as-is. Note that we don't
+ * care about preemption, since we know the ctx's are persistent. This does
+ * mean that we can't rely on ctx always matching the currently running CPU.
+ */
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return __blk_mq_get_ctx(q, get_cpu());
+}
+
+static void blk_mq_put_ctx(struct blk_mq_ctx *ctx)
+{
+	put_cpu();
+}
+
+/*
+ * Check if any of the ctx's have pending work in this hardware queue
+ */
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	return !list_empty_careful(&hctx->dispatch) ||
+		find_first_bit(hctx->ctx_map, hctx->nr_ctx) < hctx->nr_ctx;
+}
+
+/*
+ * Mark this ctx as having pending work in this hardware queue
+ */
+static void blk_mq_hctx_mark_pending(struct blk_mq_hw_ctx *hctx,
+				     struct blk_mq_ctx *ctx)
+{
+	if (!test_bit(ctx->index_hw, hctx->ctx_map))
+		set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+static struct request *__blk_mq_alloc_request(struct blk_mq_hw_ctx *hctx,
+					      gfp_t gfp, bool reserved)
+{
+	struct request *rq;
+	unsigned int tag;
+
+	tag = blk_mq_get_tag(hctx->tags, gfp, reserved);
+	if (tag == BLK_MQ_TAG_FAIL)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	blk_rq_init(hctx->queue, rq);
+	rq->tag = tag;
+
+	return rq;
+}
+
+static void blk_mq_rq_ctx_init(struct request_queue *q, struct blk_mq_ctx *ctx,
+			       struct request *rq, unsigned int rw_flags)
+{
+	rq->mq_ctx = ctx;
+	rq->cmd_flags = rw_flags;
+	if (blk_queue_io_stat(q))
+		rq->cmd_flags |= REQ_IO_STAT;
+
+	ctx->rq_dispatched[rw_is_sync(rw_flags)]++;
+}
+
+/**
+ * blk_mq_alloc_request - allocate a request from a multiqueue device
+ * @q:		the request queue
+ * @rw:		READ or WRITE, optionally with REQ_SYNC
+ * @gfp:	allocation mask, sleeps for a free tag if __GFP_WAIT is set
+ * @reserved:	allocate from the reserved tags of the hardware queue
+ *
+ * The request is taken from the hardware queue the current CPU maps to.
+ * Returns %NULL if no tag is available and @gfp does not allow waiting.
+ */
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp, bool reserved)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	rq = __blk_mq_alloc_request(hctx, gfp & ~__GFP_WAIT, reserved);
+	blk_mq_put_ctx(ctx);
+
+	/*
+	 * No free tag, sleep for one. The ctx stays valid even if we
+	 * migrate meanwhile, it is merely no longer the local one.
+	 */
+	if (!rq && (gfp & __GFP_WAIT))
+		rq = __blk_mq_alloc_request(hctx, gfp, reserved);
+
+	if (rq)
+		blk_mq_rq_ctx_init(q, ctx, rq, rw);
+
+	return rq;
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+/**
+ * blk_mq_free_request - return a request and its tag to the hardware queue
+ * @rq:	the request to free
+ */
+void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	ctx->rq_completed[rq_is_sync(rq)]++;
+
+	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+	clear_bit(REQ_ATOM_COMPLETE, &rq->atomic_flags);
+	blk_mq_put_tag(hctx->tags, rq->tag);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+/**
+ * blk_mq_end_io - end all of a request's I/O
+ * @rq:		the request being completed
+ * @error:	%0 for success, < %0 for error
+ *
+ * Completes all bios of @rq, accounts the I/O and then either calls the
+ * end_io callback of @rq or frees it.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	blk_account_io_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void blk_mq_softirq_done(struct request *rq)
+{
+	blk_mq_end_io(rq, rq->errors);
+}
+
+/**
+ * blk_mq_complete_request - end I/O on a request
+ * @rq:		the request being processed
+ *
+ * Description:
+ *	Ends all I/O on a request. Like blk_complete_request(), the completion
+ *	is finished from softirq context, on the submitting CPU group if the
+ *	queue asks for it. The driver's ->complete handler is called there,
+ *	or blk_mq_end_io() with rq->errors if it has none.
+ **/
+void blk_mq_complete_request(struct request *rq)
+{
+	blk_complete_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_complete_request);
+
+static void blk_mq_add_timer(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	unsigned long expiry;
+
+	if (!rq->timeout)
+		rq->timeout = q->rq_timeout;
+	rq->deadline = jiffies + rq->timeout;
+
+	/*
+	 * Only ever push the queue timer forward, the timer handler
+	 * re-arms it for the next pending deadline anyway.
+	 */
+	expiry = round_jiffies_up(rq->deadline);
+	if (!timer_pending(&q->timeout) ||
+	    time_before(expiry, q->timeout.expires))
+		mod_timer(&q->timeout, expiry);
+}
+
+static void blk_mq_start_request(struct request *rq)
+{
+	trace_block_rq_issue(rq->q, rq);
+
+	blk_mq_add_timer(rq);
+	set_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+}
+
+static void blk_mq_requeue_request(struct request *rq)
+{
+	trace_block_rq_requeue(rq->q, rq);
+	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+}
+
+static void blk_mq_rq_timed_out(struct request *rq)
+{
+	struct blk_mq_ops *ops = rq->q->mq_ops;
+	enum blk_eh_timer_return ret = BLK_EH_RESET_TIMER;
+
+	if (ops->timeout)
+		ret = ops->timeout(rq);
+
+	switch (ret) {
+	case BLK_EH_HANDLED:
+		__blk_complete_request(rq);
+		break;
+	case BLK_EH_RESET_TIMER:
+		blk_mq_add_timer(rq);
+		blk_clear_rq_complete(rq);
+		break;
+	case BLK_EH_NOT_HANDLED:
+		break;
+	default:
+		printk(KERN_ERR "block: bad eh return: %d\n", ret);
+		break;
+	}
+}
+
+static void blk_mq_hw_ctx_check_timeout(struct blk_mq_hw_ctx *hctx,
+					unsigned long *next, int *next_set)
+{
+	unsigned int i;
+
+	for (i = 0; i < hctx->queue_depth; i++) {
+		struct request *rq = hctx->rqs[i];
+
+		if (!test_bit(REQ_ATOM_STARTED, &rq->atomic_flags))
+			continue;
+
+		if (time_after_eq(jiffies, rq->deadline)) {
+			/*
+			 * Check if we raced with end io completion
+			 */
+			if (!blk_mark_rq_complete(rq))
+				blk_mq_rq_timed_out(rq);
+		} else if (!*next_set || time_after(*next, rq->deadline)) {
+			*next = rq->deadline;
+			*next_set = 1;
+		}
+	}
+}
+
+static void blk_mq_rq_timer(unsigned long data)
+{
+	struct request_queue *q = (struct request_queue *) data;
+	struct blk_mq_hw_ctx *hctx;
+	unsigned long next = 0;
+	int i, next_set = 0;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_hw_ctx_check_timeout(hctx, &next, &next_set);
+
+	if (next_set)
+		mod_timer(&q->timeout, round_jiffies_up(next));
+}
+
+/*
+ * Reverse check our software queue for entries that we could potentially
+ * merge with. Currently includes a hand-wavy stop count of 8, to not spend
+ * too much time checking for merges.
+ */
+static bool blk_mq_attempt_merge(struct request_queue *q,
+				 struct list_head *list, struct bio *bio)
+{
+	struct request *rq;
+	int checked = 8;
+
+	list_for_each_entry_reverse(rq, list, queuelist) {
+		int el_ret;
+
+		if (!checked--)
+			break;
+
+		if (rq->q != q)
+			continue;
+
+		el_ret = elv_try_merge(rq, bio);
+		if (el_ret == ELEVATOR_BACK_MERGE) {
+			if (bio_attempt_back_merge(q, rq, bio))
+				return true;
+		} else if (el_ret == ELEVATOR_FRONT_MERGE) {
+			if (bio_attempt_front_merge(q, rq, bio))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Run this hardware queue, pulling any software queues mapped to it in.
+ * Note that this function currently has various problems around ordering
+ * of IO. In particular, we'd like FIFO behaviour on handling existing
+ * items on the hctx->dispatch list. Ignore that for now.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int bit, queued;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	hctx->run++;
+
+	/*
+	 * Touch any software queue that has pending entries.
+	 */
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+		BUG_ON(bit != ctx->index_hw);
+
+		spin_lock_irq(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock_irq(&ctx->lock);
+	}
+
+	/*
+	 * If we have previous entries on our dispatch list, grab them
+	 * and stuff them at the front for more fair dispatch.
+	 */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock_irq(&hctx->lock);
+		if (!list_empty(&hctx->dispatch))
+			list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock_irq(&hctx->lock);
+	}
+
+	/*
+	 * Now process all the entries, sending them to the driver.
+	 */
+	queued = 0;
+	while (!list_empty(&rq_list)) {
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		blk_mq_start_request(rq);
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		switch (ret) {
+		case BLK_MQ_RQ_QUEUE_OK:
+			queued++;
+			continue;
+		case BLK_MQ_RQ_QUEUE_BUSY:
+			/*
+			 * The driver is out of resources, it should have
+			 * stopped the queue with blk_mq_stop_hw_queue().
+			 */
+			list_add(&rq->queuelist, &rq_list);
+			blk_mq_requeue_request(rq);
+			break;
+		default:
+			pr_err("blk-mq: bad return on queue: %d\n", ret);
+			rq->errors = -EIO;
+			/* fall through */
+		case BLK_MQ_RQ_QUEUE_ERROR:
+			blk_mq_end_io(rq, rq->errors ? rq->errors : -EIO);
+			break;
+		}
+
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY)
+			break;
+	}
+
+	if (!queued)
+		hctx->dispatched[0]++;
+	else if (queued < (1 << (BLK_MQ_MAX_DISPATCH_ORDER - 1)))
+		hctx->dispatched[ilog2(queued) + 1]++;
+
+	/*
+	 * Any items that need requeuing? Stuff them into hctx->dispatch,
+	 * that is where we will continue on next queue run.
+	 */
+	if (!list_empty(&rq_list)) {
+		spin_lock_irq(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock_irq(&hctx->lock);
+
+		/*
+		 * The driver may have restarted a queue it stopped on BUSY
+		 * while we still held these requests, so nobody would
+		 * pick them up. Kick another run in that case.
+		 */
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			kblockd_schedule_delayed_work(q, &hctx->delayed_work,
+						      1);
+	}
+}
+
+static void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (!async)
+		__blk_mq_run_hw_queue(hctx);
+	else
+		kblockd_schedule_delayed_work(hctx->queue, &hctx->delayed_work,
+					      0);
+}
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!blk_mq_hctx_has_pending(hctx) ||
+		    test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+/**
+ * blk_mq_stop_hw_queue - stop dispatching to a hardware queue
+ * @hctx:	the hardware queue
+ *
+ * Typically called by a driver's ->queue_rq() handler when it runs out of
+ * resources, before returning %BLK_MQ_RQ_QUEUE_BUSY. Safe to call from
+ * atomic context.
+ */
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->delayed_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_stop_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_stop_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queues);
+
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	__blk_mq_run_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+/**
+ * blk_mq_start_stopped_hw_queues - restart stopped hardware queues
+ * @q:	the request queue
+ *
+ * Restarts every stopped hardware queue of @q and runs it from kblockd,
+ * so this can be called from the driver's completion interrupt.
+ */
+void blk_mq_start_stopped_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+		blk_mq_run_hw_queue(hctx, true);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, delayed_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
+				    struct request *rq, bool at_head)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+
+	trace_block_rq_insert(hctx->queue, rq);
+
+	if (at_head)
+		list_add(&rq->queuelist, &ctx->rq_list);
+	else
+		list_add_tail(&rq->queuelist, &ctx->rq_list);
+	blk_mq_hctx_mark_pending(hctx, ctx);
+	hctx->queued++;
+}
+
+/**
+ * blk_mq_insert_request - insert a request into its software queue
+ * @q:		the request queue
+ * @rq:		the request, as returned by blk_mq_alloc_request()
+ * @at_head:	insert at the head instead of the tail
+ * @run_queue:	run the hardware queue directly afterwards
+ */
+void blk_mq_insert_request(struct request_queue *q, struct request *rq,
+			   bool at_head, bool run_queue)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	unsigned long flags;
+
+	spin_lock_irqsave(&ctx->lock, flags);
+	__blk_mq_insert_request(hctx, rq, at_head);
+	spin_unlock_irqrestore(&ctx->lock, flags);
+
+	if (run_queue)
+		blk_mq_run_hw_queue(hctx, false);
+}
+EXPORT_SYMBOL(blk_mq_insert_request);
+
+void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
+{
+	LIST_HEAD(list);
+
+	list_splice_init(&plug->mq_list, &list);
+
+	while (!list_empty(&list)) {
+		struct request *rq = list_entry_rq(list.next);
+		struct blk_mq_ctx *ctx = rq->mq_ctx;
+		struct request_queue *q = rq->q;
+		struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+		unsigned int depth = 0;
+		unsigned long flags;
+
+		/*
+		 * Insert the run of requests for this software queue under
+		 * a single lock hold, then kick the hardware queue once.
+		 */
+		spin_lock_irqsave(&ctx->lock, flags);
+		do {
+			list_del_init(&rq->queuelist);
+			__blk_mq_insert_request(hctx, rq, false);
+			depth++;
+			if (list_empty(&list))
+				break;
+			rq = list_entry_rq(list.next);
+		} while (rq->mq_ctx == ctx);
+		spin_unlock_irqrestore(&ctx->lock, flags);
+
+		trace_block_unplug(q, depth, !from_schedule);
+		blk_mq_run_hw_queue(hctx, from_schedule);
+	}
+}
+
+static void blk_mq_bio_to_request(struct request *rq, struct bio *bio)
+{
+	init_request_from_bio(rq, bio);
+
+	if (test_bit(QUEUE_FLAG_SAME_COMP, &rq->q->queue_flags) ||
+	    bio_flagged(bio, BIO_CPU_AFFINE)) {
+		rq->cpu = blk_cpu_to_group(get_cpu());
+		put_cpu();
+	}
+
+	drive_stat_acct(rq, 1);
+}
+
+static void __blk_mq_make_request(struct request_queue *q, struct bio *bio,
+				  bool may_plug)
+{
+	const int is_sync = rw_is_sync(bio->bi_rw);
+	struct blk_plug *plug = may_plug ? current->plug : NULL;
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	int rw = bio_data_dir(bio);
+
+	if (plug && blk_mq_attempt_merge(q, &plug->mq_list, bio))
+		return;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	if ((hctx->flags & BLK_MQ_F_SHOULD_MERGE) && !blk_queue_nomerges(q)) {
+		bool merged;
+
+		spin_lock_irq(&ctx->lock);
+		merged = blk_mq_attempt_merge(q, &ctx->rq_list, bio);
+		if (merged)
+			ctx->rq_merged++;
+		spin_unlock_irq(&ctx->lock);
+
+		if (merged) {
+			blk_mq_put_ctx(ctx);
+			return;
+		}
+	}
+	blk_mq_put_ctx(ctx);
+
+	if (is_sync)
+		rw |= REQ_SYNC;
+
+	trace_block_getrq(q, bio, rw);
+	rq = blk_mq_alloc_request(q, rw, GFP_NOWAIT, false);
+	if (unlikely(!rq)) {
+		trace_block_sleeprq(q, bio, rw);
+		rq = blk_mq_alloc_request(q, rw, GFP_NOIO, false);
+	}
+
+	blk_mq_bio_to_request(rq, bio);
+
+	if (plug) {
+		if (list_empty(&plug->mq_list))
+			trace_block_plug(q);
+		list_add_tail(&rq->queuelist, &plug->mq_list);
+		return;
+	}
+
+	/*
+	 * Sync I/O is dispatched directly, async I/O is left to kblockd
+	 * so that the submitter can keep going.
+	 */
+	ctx = rq->mq_ctx;
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	spin_lock_irq(&ctx->lock);
+	__blk_mq_insert_request(hctx, rq, false);
+	spin_unlock_irq(&ctx->lock);
+
+	blk_mq_run_hw_queue(hctx, !is_sync);
+}
+
+struct blk_mq_flush_wait {
+	struct completion	done;
+	int			error;
+	bio_end_io_t		*end_io;
+	void			*private;
+};
+
+static void blk_mq_flush_rq_end_io(struct request *rq, int error)
+{
+	struct blk_mq_flush_wait *wait = rq->end_io_data;
+
+	wait->error = error;
+	blk_mq_free_request(rq);
+	complete(&wait->done);
+}
+
+/*
+ * Issue an empty REQ_FLUSH request and wait for it to finish.
+ */
+static int blk_mq_issue_flush(struct request_queue *q, struct gendisk *disk)
+{
+	struct blk_mq_flush_wait wait;
+	struct request *rq;
+
+	init_completion(&wait.done);
+
+	rq = blk_mq_alloc_request(q, WRITE | REQ_SYNC, GFP_NOIO, false);
+	rq->cmd_type = REQ_TYPE_FS;
+	rq->cmd_flags |= REQ_FLUSH | REQ_FLUSH_SEQ;
+	rq->rq_disk = disk;
+	rq->end_io = blk_mq_flush_rq_end_io;
+	rq->end_io_data = &wait;
+
+	blk_mq_insert_request(q, rq, false, true);
+	wait_for_completion(&wait.done);
+
+	return wait.error;
+}
+
+static void blk_mq_flush_data_end_io(struct bio *bio, int error)
+{
+	struct blk_mq_flush_wait *wait = bio->bi_private;
+
+	wait->error = error;
+	complete(&wait->done);
+}
+
+/*
+ * blk-mq queues do not have an elevator, so the flush state machine of
+ * blk-flush.c does not apply. Sequence REQ_FLUSH and REQ_FUA bios
+ * synchronously in the submitter's context instead: pre-flush, then the
+ * data, then a post-flush if the device cannot do FUA itself.
+ */
+static void blk_mq_flush_bio(struct request_queue *q, struct bio *bio)
+{
+	struct gendisk *disk = bio->bi_bdev->bd_disk;
+	bool postflush = (bio->bi_rw & REQ_FUA) && !(q->flush_flags & REQ_FUA);
+	struct blk_mq_flush_wait wait;
+	int error = 0;
+
+	if (bio->bi_rw & REQ_FLUSH)
+		error = blk_mq_issue_flush(q, disk);
+
+	bio->bi_rw &= ~REQ_FLUSH;
+	if (!(q->flush_flags & REQ_FUA))
+		bio->bi_rw &= ~REQ_FUA;
+
+	if (error || !bio->bi_size)
+		goto out;
+
+	if (!postflush) {
+		__blk_mq_make_request(q, bio, false);
+		return;
+	}
+
+	init_completion(&wait.done);
+	wait.end_io = bio->bi_end_io;
+	wait.private = bio->bi_private;
+	bio->bi_end_io = blk_mq_flush_data_end_io;
+	bio->bi_private = &wait;
+
+	__blk_mq_make_request(q, bio, false);
+	wait_for_completion(&wait.done);
+
+	bio->bi_end_io = wait.end_io;
+	bio->bi_private = wait.private;
+	error = wait.error;
+	if (!error)
+		error = blk_mq_issue_flush(q, disk);
+out:
+	bio_endio(bio, error);
+}
+
+static int blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	/*
+	 * low level driver can indicate that it wants pages above a
+	 * certain limit bounced to low memory (ie for highmem, or even
+	 * ISA dma in theory)
+	 */
+	blk_queue_bounce(q, &bio);
+
+	if (unlikely(bio->bi_rw & (REQ_FLUSH | REQ_FUA)))
+		blk_mq_flush_bio(q, bio);
+	else
+		__blk_mq_make_request(q, bio, true);
+
+	return 0;
+}
+
+/*
+ * Default mapping to a software queue, since we use one per CPU.
+ */
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+struct blk_mq_hw_ctx *blk_mq_alloc_single_hw_queue(struct blk_mq_reg *reg,
+						   unsigned int hctx_index)
+{
+	return kzalloc_node(sizeof(struct blk_mq_hw_ctx), GFP_KERNEL,
+			    reg->numa_node);
+}
+EXPORT_SYMBOL(blk_mq_alloc_single_hw_queue);
+
+void blk_mq_free_single_hw_queue(struct blk_mq_hw_ctx *hctx,
+				 unsigned int hctx_index)
+{
+	kfree(hctx);
+}
+EXPORT_SYMBOL(blk_mq_free_single_hw_queue);
+
+/**
+ * blk_mq_tag_to_rq - look up the request belonging to a tag
+ * @hctx:	the hardware queue the tag was allocated from
+ * @tag:	the tag, rq->tag of the request
+ */
+struct request *blk_mq_tag_to_rq(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	return hctx->rqs[tag];
+}
+EXPORT_SYMBOL(blk_mq_tag_to_rq);
+
+bool blk_mq_can_queue(struct blk_mq_hw_ctx *hctx)
+{
+	return blk_mq_has_free_tags(hctx->tags);
+}
+EXPORT_SYMBOL(blk_mq_can_queue);
+
+/**
+ * blk_mq_init_commands - initialize the driver data of all requests
+ * @q:		the request queue
+ * @init:	called once for every preallocated request
+ * @data:	passed to @init
+ *
+ * Lets the driver set up the per-request data it asked for with
+ * blk_mq_reg.cmd_size once, instead of on every submission.
+ */
+void blk_mq_init_commands(struct request_queue *q,
+		void (*init)(void *, struct blk_mq_hw_ctx *,
+			     struct request *, unsigned int),
+		void *data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		unsigned int j;
+
+		for (j = 0; j < hctx->queue_depth; j++) {
+			struct request *rq = hctx->rqs[j];
+
+			init(data, hctx, rq, j);
+		}
+	}
+}
+EXPORT_SYMBOL(blk_mq_init_commands);
+
+static void blk_mq_free_rq_map(struct blk_mq_hw_ctx *hctx)
+{
+	struct page *page;
+
+	while (!list_empty(&hctx->page_list)) {
+		page = list_first_entry(&hctx->page_list, struct page, lru);
+		list_del_init(&page->lru);
+		__free_pages(page, page->private);
+	}
+
+	kfree(hctx->rqs);
+	hctx->rqs = NULL;
+
+	blk_mq_free_tags(hctx->tags);
+	hctx->tags = NULL;
+}
+
+static size_t order_to_size(unsigned int order)
+{
+	size_t ret = PAGE_SIZE;
+
+	while (order--)
+		ret *= 2;
+
+	return ret;
+}
+
+/*
+ * Preallocate queue_depth requests for this hardware queue, carving them
+ * out of as few high order pages as we can get.
+ */
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
+			      unsigned int reserved_tags, int node)
+{
+	unsigned int i, j, entries_per_page, max_order = 4;
+	size_t rq_size, left;
+
+	INIT_LIST_HEAD(&hctx->page_list);
+
+	hctx->rqs = kmalloc_node(hctx->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL | __GFP_ZERO, node);
+	if (!hctx->rqs)
+		return -ENOMEM;
+
+	/*
+	 * rq_size is the size of the request plus driver payload, rounded
+	 * to the cacheline size
+	 */
+	rq_size = round_up(sizeof(struct request) + hctx->cmd_size,
+			   cache_line_size());
+	left = rq_size * hctx->queue_depth;
+
+	for (i = 0; i < hctx->queue_depth;) {
+		int this_order = max_order;
+		struct page *page;
+		int to_do;
+		void *p;
+
+		while (this_order && left < order_to_size(this_order - 1))
+			this_order--;
+
+		do {
+			page = alloc_pages_node(node, GFP_KERNEL | __GFP_NOWARN,
+						this_order);
+			if (page)
+				break;
+			if (!this_order--)
+				break;
+			if (order_to_size(this_order) < rq_size)
+				break;
+		} while (1);
+
+		if (!page)
+			break;
+
+		page->private = this_order;
+		list_add_tail(&page->lru, &hctx->page_list);
+
+		p = page_address(page);
+		entries_per_page = order_to_size(this_order) / rq_size;
+		to_do = min(entries_per_page, hctx->queue_depth - i);
+		left -= to_do * rq_size;
+		for (j = 0; j < to_do; j++) {
+			hctx->rqs[i] = p;
+			blk_rq_init(hctx->queue, hctx->rqs[i]);
+			p += rq_size;
+			i++;
+		}
+	}
+
+	if (i < (reserved_tags + BLK_MQ_TAG_MIN))
+		goto err_rq_map;
+	else if (i != hctx->queue_depth) {
+		hctx->queue_depth = i;
+		pr_warn("%s: queue depth set to %u because of low memory\n",
+					__func__, i);
+	}
+
+	hctx->tags = blk_mq_init_tags(hctx->queue_depth, reserved_tags, node);
+	if (!hctx->tags)
+		goto err_rq_map;
+
+	return 0;
+
+err_rq_map:
+	blk_mq_free_rq_map(hctx);
+	return -ENOMEM;
+}
+
+static void blk_mq_free_hw_queue_data(struct blk_mq_hw_ctx *hctx)
+{
+	blk_mq_free_rq_map(hctx);
+	kfree(hctx->ctxs);
+	kfree(hctx->ctx_map);
+	free_cpumask_var(hctx->cpumask);
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_reg *reg, void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i, j;
+
+	/*
+	 * Initialize hardware queues
+	 */
+	queue_for_each_hw_ctx(q, hctx, i) {
+		int node;
+
+		node = hctx->numa_node;
+		if (node == NUMA_NO_NODE)
+			node = hctx->numa_node = reg->numa_node;
+
+		INIT_DELAYED_WORK(&hctx->delayed_work, blk_mq_work_fn);
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		INIT_LIST_HEAD(&hctx->page_list);
+		hctx->queue = q;
+		hctx->queue_num = i;
+		hctx->flags = reg->flags;
+		hctx->queue_depth = reg->queue_depth;
+		hctx->cmd_size = reg->cmd_size;
+
+		if (!zalloc_cpumask_var_node(&hctx->cpumask, GFP_KERNEL, node))
+			break;
+
+		if (blk_mq_init_rq_map(hctx, reg->reserved_tags, node))
+			break;
+
+		/*
+		 * Allocate space for all possible cpus to avoid allocation in
+		 * runtime
+		 */
+		hctx->ctxs = kmalloc_node(nr_cpu_ids * sizeof(void *),
+					  GFP_KERNEL, node);
+		if (!hctx->ctxs)
+			break;
+
+		hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(nr_cpu_ids) *
+					     sizeof(unsigned long), GFP_KERNEL,
+					     node);
+		if (!hctx->ctx_map)
+			break;
+
+		hctx->nr_ctx = 0;
+
+		if (reg->ops->init_hctx &&
+		    reg->ops->init_hctx(hctx, driver_data, i))
+			break;
+	}
+
+	if (i == q->nr_hw_queues)
+		return 0;
+
+	/*
+	 * Init failed
+	 */
+	queue_for_each_hw_ctx(q, hctx, j) {
+		if (i == j)
+			break;
+
+		if (reg->ops->exit_hctx)
+			reg->ops->exit_hctx(hctx, j);
+
+		blk_mq_free_hw_queue_data(hctx);
+	}
+	blk_mq_free_hw_queue_data(q->queue_hw_ctx[i]);
+
+	return 1;
+}
+
+static void blk_mq_init_cpu_queues(struct request_queue *q,
+				   unsigned int nr_hw_queues)
+{
+	unsigned int i;
+
+	for_each_possible_cpu(i) {
+		struct blk_mq_ctx *__ctx = per_cpu_ptr(q->queue_ctx, i);
+		struct blk_mq_hw_ctx *hctx;
+
+		memset(__ctx, 0, sizeof(*__ctx));
+		__ctx->cpu = i;
+		spin_lock_init(&__ctx->lock);
+		INIT_LIST_HEAD(&__ctx->rq_list);
+		__ctx->queue = q;
+
+		/*
+		 * Set local node, IFF we have more than one hw queue. If
+		 * not, we remain on the home node of the device
+		 */
+		hctx = q->mq_ops->map_queue(q, i);
+		if (nr_hw_queues > 1 && hctx->numa_node == NUMA_NO_NODE)
+			hctx->numa_node = cpu_to_node(i);
+	}
+}
+
+static void blk_mq_map_swqueue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		cpumask_clear(hctx->cpumask);
+		hctx->nr_ctx = 0;
+	}
+
+	/*
+	 * Map software to hardware queues
+	 */
+	for_each_possible_cpu(i) {
+		ctx = __blk_mq_get_ctx(q, i);
+		hctx = q->mq_ops->map_queue(q, i);
+		cpumask_set_cpu(i, hctx->cpumask);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+}
+
+/**
+ * blk_mq_init_queue - set up a multiqueue request queue
+ * @reg:	description of the hardware queues and driver callbacks
+ * @driver_data: passed to the driver's ->init_hctx()
+ *
+ * Description:
+ *    The multiqueue counterpart of blk_init_queue(). Allocates the queue,
+ *    the per-cpu software queues, @reg->nr_hw_queues hardware queues and
+ *    @reg->queue_depth preallocated requests for each of them.
+ *    Returns an ERR_PTR() on failure.
+ **/
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct blk_mq_hw_ctx **hctxs;
+	struct blk_mq_ctx *ctx;
+	struct request_queue *q;
+	int i;
+
+	if (!reg->nr_hw_queues ||
+	    !reg->ops->queue_rq || !reg->ops->map_queue ||
+	    !reg->ops->alloc_hctx || !reg->ops->free_hctx)
+		return ERR_PTR(-EINVAL);
+
+	if (!reg->queue_depth)
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	else if (reg->queue_depth > BLK_MQ_MAX_DEPTH) {
+		pr_err("blk-mq: queuedepth too large (%u)\n", reg->queue_depth);
+		reg->queue_depth = BLK_MQ_MAX_DEPTH;
+	}
+
+	if (reg->queue_depth < (reg->reserved_tags + BLK_MQ_TAG_MIN))
+		return ERR_PTR(-EINVAL);
+
+	ctx = alloc_percpu(struct blk_mq_ctx);
+	if (!ctx)
+		return ERR_PTR(-ENOMEM);
+
+	hctxs = kmalloc_node(reg->nr_hw_queues * sizeof(*hctxs),
+			     GFP_KERNEL | __GFP_ZERO, reg->numa_node);
+	if (!hctxs)
+		goto err_percpu;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		hctxs[i] = reg->ops->alloc_hctx(reg, i);
+		if (!hctxs[i])
+			goto err_hctxs;
+
+		hctxs[i]->numa_node = NUMA_NO_NODE;
+		hctxs[i]->queue_num = i;
+	}
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		goto err_hctxs;
+
+	q->mq_map = blk_mq_make_queue_map(reg);
+	if (!q->mq_map)
+		goto err_map;
+
+	q->nr_queues = nr_cpu_ids;
+	q->nr_hw_queues = reg->nr_hw_queues;
+
+	q->queue_ctx = ctx;
+	q->queue_hw_ctx = hctxs;
+
+	q->mq_ops = reg->ops;
+
+	q->queue_flags |= (1 << QUEUE_FLAG_IO_STAT) |
+			  (1 << QUEUE_FLAG_SAME_COMP) |
+			  (1 << QUEUE_FLAG_ADD_RANDOM);
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	q->nr_requests = reg->queue_depth;
+
+	blk_queue_rq_timeout(q, reg->timeout ? reg->timeout : 30 * HZ);
+	setup_timer(&q->timeout, blk_mq_rq_timer, (unsigned long) q);
+
+	if (reg->ops->complete)
+		blk_queue_softirq_done(q, reg->ops->complete);
+	else
+		blk_queue_softirq_done(q, blk_mq_softirq_done);
+
+	blk_mq_init_cpu_queues(q, reg->nr_hw_queues);
+
+	if (blk_mq_init_hw_queues(q, reg, driver_data))
+		goto err_hw;
+
+	blk_mq_map_swqueue(q);
+
+	return q;
+
+err_hw:
+	kfree(q->mq_map);
+err_map:
+	/*
+	 * Tear down the bare queue by hand, blk_release_queue() would
+	 * try to free the hardware queues again.
+	 */
+	q->mq_ops = NULL;
+	q->queue_ctx = NULL;
+	q->queue_hw_ctx = NULL;
+	q->nr_hw_queues = 0;
+	blk_cleanup_queue(q);
+err_hctxs:
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		if (!hctxs[i])
+			break;
+		reg->ops->free_hctx(hctxs[i], i);
+	}
+	kfree(hctxs);
+err_percpu:
+	free_percpu(ctx);
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		cancel_delayed_work_sync(&hctx->delayed_work);
+		if (q->mq_ops->exit_hctx)
+			q->mq_ops->exit_hctx(hctx, i);
+		blk_mq_free_hw_queue_data(hctx);
+		q->mq_ops->free_hctx(hctx, i);
+	}
+
+	kfree(q->queue_hw_ctx);
+	free_percpu(q->queue_ctx);
+	kfree(q->mq_map);
+
+	q->queue_hw_ctx = NULL;
+	q->queue_ctx = NULL;
+	q->mq_map = NULL;
+}
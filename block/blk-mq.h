@@ -0,0 +1,55 @@
+#ifndef INT_BLK_MQ_H
+#define INT_BLK_MQ_H
+
+/*
+ * Per-cpu software submission queue
+ */
+struct blk_mq_ctx {
+	struct {
+		spinlock_t		lock;
+		struct list_head	rq_list;
+	}  ____cacheline_aligned_in_smp;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* slot in hctx->ctxs[] */
+
+	/* incremented at dispatch time */
+	unsigned long		rq_dispatched[2];
+	unsigned long		rq_merged;
+
+	/* incremented at completion time */
+	unsigned long		____cacheline_aligned_in_smp rq_completed[2];
+
+	struct request_queue	*queue;
+};
+
+void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule);
+void blk_mq_free_queue(struct request_queue *q);
+
+/*
+ * CPU -> queue mappings
+ */
+unsigned int *blk_mq_make_queue_map(struct blk_mq_reg *reg);
+int blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues);
+
+/*
+ * sysfs helpers
+ */
+int blk_mq_register_disk(struct gendisk *disk);
+void blk_mq_unregister_disk(struct gendisk *disk);
+
+/*
+ * Tag allocation
+ */
+#define BLK_MQ_TAG_FAIL		((unsigned int) -1)
+#define BLK_MQ_TAG_MIN		1
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int nr_tags,
+				     unsigned int reserved_tags, int node);
+void blk_mq_free_tags(struct blk_mq_tags *tags);
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp, bool reserved);
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag);
+bool blk_mq_has_free_tags(struct blk_mq_tags *tags);
+ssize_t blk_mq_tag_sysfs_show(struct blk_mq_tags *tags, char *page);
+
+#endif
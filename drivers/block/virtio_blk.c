@@ -2,6 +2,7 @@
 #include <linux/spinlock.h>
 #include <linux/slab.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/hdreg.h>
 #include <linux/virtio.h>
 #include <linux/virtio_blk.h>
@@ -11,6 +12,10 @@
 
 static int major, index;
 
+static int use_mq;
+module_param(use_mq, bool, 0444);
+MODULE_PARM_DESC(use_mq, "Use the multi-queue block layer (blk-mq)");
+
 struct virtio_blk
 {
 	spinlock_t lock;
@@ -21,6 +26,9 @@ struct virtio_blk
 	/* The disk structure for the kernel. */
 	struct gendisk *disk;
 
+	/* Requests come from blk-mq rather than the request_fn. */
+	bool mq;
+
 	/* Request tracking. */
 	struct list_head reqs;
 
@@ -40,6 +48,9 @@ struct virtblk_req
 	struct virtio_blk_outhdr out_hdr;
 	struct virtio_scsi_inhdr in_hdr;
 	u8 status;
+
+	/* With blk-mq, each request carries its own sg_elems entries. */
+	struct scatterlist sg[];
 };
 
 static void blk_done(struct virtqueue *vq)
@@ -78,25 +89,32 @@ static void blk_done(struct virtqueue *vq)
 			break;
 		}
 
+		if (vblk->mq) {
+			blk_mq_end_io(vbr->req, error);
+			continue;
+		}
+
 		__blk_end_request_all(vbr->req, error);
 		list_del(&vbr->list);
 		mempool_free(vbr, vblk->pool);
 	}
 	/* In case queue is stopped waiting for more buffers. */
-	blk_start_queue(vblk->disk->queue);
+	if (vblk->mq)
+		blk_mq_start_stopped_hw_queues(vblk->disk->queue);
+	else
+		blk_start_queue(vblk->disk->queue);
 	spin_unlock_irqrestore(&vblk->lock, flags);
 }
 
-static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
-		   struct request *req)
+/*
+ * Build the descriptor chain for @req in @sg and add it to the virtqueue.
+ * Called with vblk->lock held.
+ */
+static bool virtblk_add_req(struct request_queue *q, struct virtio_blk *vblk,
+			    struct virtblk_req *vbr, struct request *req,
+			    struct scatterlist *sg)
 {
 	unsigned long num, out = 0, in = 0;
-	struct virtblk_req *vbr;
-
-	vbr = mempool_alloc(vblk->pool, GFP_ATOMIC);
-	if (!vbr)
-		/* When another request finishes we'll try again. */
-		return false;
 
 	vbr->req = req;
 
@@ -127,7 +145,7 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	sg_set_buf(&vblk->sg[out++], &vbr->out_hdr, sizeof(vbr->out_hdr));
+	sg_set_buf(&sg[out++], &vbr->out_hdr, sizeof(vbr->out_hdr));
 
 	/*
 	 * If this is a packet command we need a couple of additional headers.
@@ -136,18 +154,17 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 	 * inhdr with additional status information before the normal inhdr.
 	 */
 	if (vbr->req->cmd_type == REQ_TYPE_BLOCK_PC)
-		sg_set_buf(&vblk->sg[out++], vbr->req->cmd, vbr->req->cmd_len);
+		sg_set_buf(&sg[out++], vbr->req->cmd, vbr->req->cmd_len);
 
-	num = blk_rq_map_sg(q, vbr->req, vblk->sg + out);
+	num = blk_rq_map_sg(q, vbr->req, sg + out);
 
 	if (vbr->req->cmd_type == REQ_TYPE_BLOCK_PC) {
-		sg_set_buf(&vblk->sg[num + out + in++], vbr->req->sense, 96);
-		sg_set_buf(&vblk->sg[num + out + in++], &vbr->in_hdr,
+		sg_set_buf(&sg[num + out + in++], vbr->req->sense, 96);
+		sg_set_buf(&sg[num + out + in++], &vbr->in_hdr,
 			   sizeof(vbr->in_hdr));
 	}
 
-	sg_set_buf(&vblk->sg[num + out + in++], &vbr->status,
-		   sizeof(vbr->status));
+	sg_set_buf(&sg[num + out + in++], &vbr->status, sizeof(vbr->status));
 
 	if (num) {
 		if (rq_data_dir(vbr->req) == WRITE) {
@@ -159,7 +176,20 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	if (virtqueue_add_buf(vblk->vq, vblk->sg, out, in, vbr) < 0) {
+	return virtqueue_add_buf(vblk->vq, sg, out, in, vbr) >= 0;
+}
+
+static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
+		   struct request *req)
+{
+	struct virtblk_req *vbr;
+
+	vbr = mempool_alloc(vblk->pool, GFP_ATOMIC);
+	if (!vbr)
+		/* When another request finishes we'll try again. */
+		return false;
+
+	if (!virtblk_add_req(q, vblk, vbr, req, vblk->sg)) {
 		mempool_free(vbr, vblk->pool);
 		return false;
 	}
@@ -191,6 +221,65 @@ static void do_virtblk_request(struct request_queue *q)
 		virtqueue_kick(vblk->vq);
 }
 
+static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *req)
+{
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	struct virtblk_req *vbr = blk_mq_rq_to_pdu(req);
+	unsigned long flags;
+	bool queued;
+
+	BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
+
+	spin_lock_irqsave(&vblk->lock, flags);
+	queued = virtblk_add_req(hctx->queue, vblk, vbr, req, vbr->sg);
+	if (queued)
+		virtqueue_kick(vblk->vq);
+	else
+		/* blk_done() restarts us once a buffer comes back. */
+		blk_mq_stop_hw_queue(hctx);
+	spin_unlock_irqrestore(&vblk->lock, flags);
+
+	return queued ? BLK_MQ_RQ_QUEUE_OK : BLK_MQ_RQ_QUEUE_BUSY;
+}
+
+static struct blk_mq_ops virtio_mq_ops = {
+	.queue_rq	= virtio_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.alloc_hctx	= blk_mq_alloc_single_hw_queue,
+	.free_hctx	= blk_mq_free_single_hw_queue,
+};
+
+static void virtblk_init_vbr(void *data, struct blk_mq_hw_ctx *hctx,
+			     struct request *rq, unsigned int nr)
+{
+	struct virtio_blk *vblk = data;
+	struct virtblk_req *vbr = blk_mq_rq_to_pdu(rq);
+
+	sg_init_table(vbr->sg, vblk->sg_elems);
+}
+
+static struct request_queue *virtblk_init_mq(struct virtio_blk *vblk)
+{
+	struct blk_mq_reg reg = {
+		.ops		= &virtio_mq_ops,
+		.nr_hw_queues	= 1,
+		.queue_depth	= 64,
+		.numa_node	= NUMA_NO_NODE,
+		.flags		= BLK_MQ_F_SHOULD_MERGE,
+	};
+	struct request_queue *q;
+
+	reg.cmd_size = sizeof(struct virtblk_req) +
+		       sizeof(struct scatterlist) * vblk->sg_elems;
+
+	q = blk_mq_init_queue(&reg, vblk);
+	if (IS_ERR(q))
+		return NULL;
+
+	blk_mq_init_commands(q, virtblk_init_vbr, vblk);
+	return q;
+}
+
 /* return id (s/n) string for *disk to *id_str
  */
 static int virtblk_get_id(struct gendisk *disk, char *id_str)
@@ -324,6 +413,7 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 
 	INIT_LIST_HEAD(&vblk->reqs);
 	spin_lock_init(&vblk->lock);
+	vblk->mq = use_mq;
 	vblk->vdev = vdev;
 	vblk->sg_elems = sg_elems;
 	sg_init_table(vblk->sg, vblk->sg_elems);
@@ -348,7 +438,11 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 		goto out_mempool;
 	}
 
-	q = vblk->disk->queue = blk_init_queue(do_virtblk_request, &vblk->lock);
+	if (vblk->mq)
+		q = virtblk_init_mq(vblk);
+	else
+		q = blk_init_queue(do_virtblk_request, &vblk->lock);
+	vblk->disk->queue = q;
 	if (!q) {
 		err = -ENOMEM;
 		goto out_put_disk;
@@ -126,6 +126,9 @@ static void skb_xmit_done(struct virtqueue *svq)
 
 	/* We were probably waiting for more output buffers. */
 	netif_wake_queue(vi->dev);
+
+	/* Or for the host to use some, so that start_xmit() can reap them. */
+	netdev_tx_completion_pending(netdev_get_tx_queue(vi->dev, 0));
 }
 
 static void set_skb_frag(struct sk_buff *skb, struct page *page,
@@ -513,14 +516,18 @@ static unsigned int free_old_xmit_skbs(struct virtnet_info *vi)
 {
 	struct sk_buff *skb;
 	unsigned int len, tot_sgs = 0;
+	unsigned int bytes = 0, packets = 0;
 
 	while ((skb = virtqueue_get_buf(vi->svq, &len)) != NULL) {
 		pr_debug("Sent skb %p\n", skb);
-		vi->dev->stats.tx_bytes += skb->len;
-		vi->dev->stats.tx_packets++;
+		bytes += skb->len;
+		packets++;
 		tot_sgs += skb_vnet_hdr(skb)->num_sg;
 		dev_kfree_skb_any(skb);
 	}
+	vi->dev->stats.tx_bytes += bytes;
+	vi->dev->stats.tx_packets += packets;
+	netdev_completed_queue(vi->dev, packets, bytes);
 	return tot_sgs;
 }
 
@@ -574,6 +581,7 @@ static int xmit_skb(struct virtnet_info *vi, struct sk_buff *skb)
 static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct virtnet_info *vi = netdev_priv(dev);
+	struct netdev_queue *txq = netdev_get_tx_queue(dev, 0);
 	int capacity;
 
 	/* Free up any pending old buffers before queueing new ones. */
@@ -599,6 +607,7 @@ static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 		kfree_skb(skb);
 		return NETDEV_TX_OK;
 	}
+	netdev_sent_queue(dev, skb->len);
 	virtqueue_kick(vi->svq);
 
 	/* Don't wait up for transmitted skbs to be freed. */
@@ -607,16 +616,20 @@ static netdev_tx_t start_xmit(struct sk_buff *skb, struct net_device *dev)
 
 	/* Apparently nice girls don't return TX_BUSY; stop the queue
 	 * before it gets out of hand.  Naturally, this wastes entries. */
-	if (capacity < 2+MAX_SKB_FRAGS) {
+	if (capacity < 2+MAX_SKB_FRAGS)
 		netif_stop_queue(dev);
-		if (unlikely(!virtqueue_enable_cb(vi->svq))) {
-			/* More just got used, free them then recheck. */
-			capacity += free_old_xmit_skbs(vi);
-			if (capacity >= 2+MAX_SKB_FRAGS) {
-				netif_start_queue(dev);
-				virtqueue_disable_cb(vi->svq);
-			}
-		}
+
+	/* Used buffers are only reaped here: whether we stopped the queue
+	 * or byte queue limits did, have the host tell us when it used
+	 * some more. */
+	if (netif_xmit_stopped(txq) &&
+	    unlikely(!virtqueue_enable_cb(vi->svq))) {
+		/* More just got used, free them then recheck. */
+		capacity += free_old_xmit_skbs(vi);
+		if (capacity >= 2+MAX_SKB_FRAGS)
+			netif_start_queue(dev);
+		if (!netif_xmit_stopped(txq))
+			virtqueue_disable_cb(vi->svq);
 	}
 
 	return NETDEV_TX_OK;
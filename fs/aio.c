@@ -228,22 +228,43 @@ static void __put_ioctx(struct kioctx *ctx)
 	call_rcu(&ctx->rcu_head, ctx_rcu_free);
 }
 
+static void free_ioctx_work(struct work_struct *work)
+{
+	struct kioctx *ctx = container_of(work, struct kioctx, free_work);
+
+	percpu_ref_exit(&ctx->users);
+	__put_ioctx(ctx);
+}
+
+/*
+ * The last reference can be dropped from aio_complete(), in interrupt
+ * context, while freeing the context has to sleep.
+ */
+static void free_ioctx_ref(struct percpu_ref *ref)
+{
+	struct kioctx *ctx = container_of(ref, struct kioctx, users);
+
+	schedule_work(&ctx->free_work);
+}
+
+/*
+ * The users count is a percpu_ref: the get and put done for every
+ * submitted request only touch a per-cpu counter until the context is
+ * killed by io_destroy() or exit_aio().
+ */
 static inline void get_ioctx(struct kioctx *kioctx)
 {
-	BUG_ON(atomic_read(&kioctx->users) <= 0);
-	atomic_inc(&kioctx->users);
+	percpu_ref_get(&kioctx->users);
 }
 
 static inline int try_get_ioctx(struct kioctx *kioctx)
 {
-	return atomic_inc_not_zero(&kioctx->users);
+	return percpu_ref_tryget(&kioctx->users);
 }
 
 static inline void put_ioctx(struct kioctx *kioctx)
 {
-	BUG_ON(atomic_read(&kioctx->users) <= 0);
-	if (unlikely(atomic_dec_and_test(&kioctx->users)))
-		__put_ioctx(kioctx);
+	percpu_ref_put(&kioctx->users);
 }
 
 /* ioctx_alloc
@@ -273,7 +294,9 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	mm = ctx->mm = current->mm;
 	atomic_inc(&mm->mm_count);
 
-	atomic_set(&ctx->users, 1);
+	if (percpu_ref_init(&ctx->users, free_ioctx_ref, 0))
+		goto out_freectx;
+
 	spin_lock_init(&ctx->ctx_lock);
 	spin_lock_init(&ctx->ring_info.ring_lock);
 	init_waitqueue_head(&ctx->wait);
@@ -281,9 +304,10 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	INIT_LIST_HEAD(&ctx->active_reqs);
 	INIT_LIST_HEAD(&ctx->run_list);
 	INIT_DELAYED_WORK(&ctx->wq, aio_kick_handler);
+	INIT_WORK(&ctx->free_work, free_ioctx_work);
 
 	if (aio_setup_ring(ctx) < 0)
-		goto out_freectx;
+		goto out_freeref;
 
 	/* limit the number of system wide aios */
 	do {
@@ -316,9 +340,12 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	return ctx;
 
 out_cleanup:
+	percpu_ref_exit(&ctx->users);
 	__put_ioctx(ctx);
 	return ERR_PTR(-EAGAIN);
 
+out_freeref:
+	percpu_ref_exit(&ctx->users);
 out_freectx:
 	mmdrop(mm);
 	kmem_cache_free(kioctx_cachep, ctx);
@@ -418,12 +445,14 @@ void exit_aio(struct mm_struct *mm)
 		 */
 		cancel_work_sync(&ctx->wq.work);
 
-		if (1 != atomic_read(&ctx->users))
-			printk(KERN_DEBUG
-				"exit_aio:ioctx still alive: %d %d %d\n",
-				atomic_read(&ctx->users), ctx->dead,
-				ctx->reqs_active);
-		put_ioctx(ctx);
+		/*
+		 * The ctx is freed asynchronously, possibly after this mm
+		 * is gone: exit_mmap() tears the ring mapping down, so
+		 * aio_free_ring() must not munmap it.
+		 */
+		ctx->ring_info.mmap_size = 0;
+
+		percpu_ref_kill(&ctx->users);
 	}
 }
 
@@ -1208,7 +1237,7 @@ static void io_destroy(struct kioctx *ioctx)
 
 	dprintk("aio_release(%p)\n", ioctx);
 	if (likely(!was_dead))
-		put_ioctx(ioctx);	/* twice for the list */
+		percpu_ref_kill(&ioctx->users);	/* the list's reference */
 
 	aio_cancel_all(ioctx);
 	wait_for_all_aios(ioctx);
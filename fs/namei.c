@@ -422,11 +422,9 @@ static int nameidata_drop_rcu(struct nameidata *nd)
 				nd->root.dentry != fs->root.dentry)
 			goto err_root;
 	}
-	spin_lock(&dentry->d_lock);
 	if (!__d_rcu_to_refcount(dentry, nd->seq))
-		goto err;
+		goto err_root;
 	BUG_ON(nd->inode != dentry->d_inode);
-	spin_unlock(&dentry->d_lock);
 	if (want_root) {
 		path_get(&nd->root);
 		spin_unlock(&fs->lock);
@@ -437,8 +435,6 @@ static int nameidata_drop_rcu(struct nameidata *nd)
 	br_read_unlock(vfsmount_lock);
 	nd->flags &= ~LOOKUP_RCU;
 	return 0;
-err:
-	spin_unlock(&dentry->d_lock);
 err_root:
 	if (want_root)
 		spin_unlock(&fs->lock);
@@ -477,20 +473,16 @@ static int nameidata_dentry_drop_rcu(struct nameidata *nd, struct dentry *dentry
 				nd->root.dentry != fs->root.dentry)
 			goto err_root;
 	}
-	spin_lock(&parent->d_lock);
-	spin_lock_nested(&dentry->d_lock, DENTRY_D_LOCK_NESTED);
-	if (!__d_rcu_to_refcount(dentry, nd->seq))
-		goto err;
 	/*
-	 * If the sequence check on the child dentry passed, then the child has
-	 * not been removed from its parent. This means the parent dentry must
-	 * be valid and able to take a reference at this point.
+	 * Pin the parent first: if the sequence check on the child dentry
+	 * then passes, the child has not been removed from its parent, so
+	 * the reference we hold is on the right dentry.
 	 */
+	if (!lockref_get_not_dead(&parent->d_lockref))
+		goto err_root;
+	if (!__d_rcu_to_refcount(dentry, nd->seq))
+		goto err;
 	BUG_ON(!IS_ROOT(dentry) && dentry->d_parent != parent);
-	BUG_ON(!parent->d_count);
-	parent->d_count++;
-	spin_unlock(&dentry->d_lock);
-	spin_unlock(&parent->d_lock);
 	if (want_root) {
 		path_get(&nd->root);
 		spin_unlock(&fs->lock);
@@ -502,8 +494,7 @@ static int nameidata_dentry_drop_rcu(struct nameidata *nd, struct dentry *dentry
 	nd->flags &= ~LOOKUP_RCU;
 	return 0;
 err:
-	spin_unlock(&dentry->d_lock);
-	spin_unlock(&parent->d_lock);
+	__d_rcu_unref(parent);
 err_root:
 	if (want_root)
 		spin_unlock(&fs->lock);
@@ -543,11 +534,9 @@ static int nameidata_drop_rcu_last(struct nameidata *nd)
 	nd->flags &= ~LOOKUP_RCU;
 	if (!(nd->flags & LOOKUP_ROOT))
 		nd->root.mnt = NULL;
-	spin_lock(&dentry->d_lock);
 	if (!__d_rcu_to_refcount(dentry, nd->seq))
-		goto err_unlock;
+		goto err;
 	BUG_ON(nd->inode != dentry->d_inode);
-	spin_unlock(&dentry->d_lock);
 
 	mntget(nd->path.mnt);
 
@@ -556,8 +545,7 @@ static int nameidata_drop_rcu_last(struct nameidata *nd)
 
 	return 0;
 
-err_unlock:
-	spin_unlock(&dentry->d_lock);
+err:
 	rcu_read_unlock();
 	br_read_unlock(vfsmount_lock);
 	return -ECHILD;
@@ -2648,7 +2636,7 @@ void dentry_unhash(struct dentry *dentry)
 	dget(dentry);
 	shrink_dcache_parent(dentry);
 	spin_lock(&dentry->d_lock);
-	if (dentry->d_count == 2)
+	if (d_count(dentry) == 2)
 		__d_drop(dentry);
 	spin_unlock(&dentry->d_lock);
 }
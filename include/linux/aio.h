@@ -6,6 +6,7 @@
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
 #include <linux/rcupdate.h>
+#include <linux/percpu-refcount.h>
 
 #include <asm/atomic.h>
 
@@ -176,7 +177,7 @@ struct aio_ring_info {
 };
 
 struct kioctx {
-	atomic_t		users;
+	struct percpu_ref	users;
 	int			dead;
 	struct mm_struct	*mm;
 
@@ -199,6 +200,7 @@ struct kioctx {
 
 	struct delayed_work	wq;
 
+	struct work_struct	free_work;
 	struct rcu_head		rcu_head;
 };
 
@@ -0,0 +1,75 @@
+/*
+ * Context tracking: probes on the kernel/user boundary
+ *
+ * On CPUs where it is active, the architecture calls user_exit() when
+ * a task enters the kernel from userspace (syscall or exception) and
+ * user_enter() right before it returns there. While a CPU runs in
+ * userspace it is in an RCU extended quiescent state, so RCU does not
+ * need the tick to see it pass through quiescent states, and its
+ * cputime is accounted at the boundaries rather than sampled by the
+ * tick. Interrupts that hit userspace are covered by rcu_irq_enter()
+ * and rcu_irq_exit().
+ *
+ * Full dynticks CPUs are the users of this.
+ */
+#ifndef _LINUX_CONTEXT_TRACKING_H
+#define _LINUX_CONTEXT_TRACKING_H
+
+#include <linux/percpu.h>
+#include <linux/sched.h>
+
+enum ctx_state {
+	IN_KERNEL = 0,
+	IN_USER,
+};
+
+struct context_tracking {
+	bool		active;		/* the probes do something on this cpu */
+	enum ctx_state	state;
+	unsigned long	vtime_snap;	/* jiffies at the last boundary */
+};
+
+#ifdef CONFIG_CONTEXT_TRACKING
+DECLARE_PER_CPU(struct context_tracking, context_tracking);
+
+static inline bool context_tracking_active(void)
+{
+	return __this_cpu_read(context_tracking.active);
+}
+
+extern void context_tracking_cpu_set(int cpu);
+extern void user_enter(void);
+extern void user_exit(void);
+extern void context_tracking_task_switch(struct task_struct *prev);
+extern void vtime_account_tick(struct task_struct *tsk, int user_tick);
+
+/*
+ * Exceptions may hit either mode: leave userspace if that is where we
+ * came from and go back there on the way out.
+ */
+static inline enum ctx_state exception_enter(void)
+{
+	enum ctx_state prev_state;
+
+	prev_state = this_cpu_read(context_tracking.state);
+	user_exit();
+
+	return prev_state;
+}
+
+static inline void exception_exit(enum ctx_state prev_state)
+{
+	if (prev_state == IN_USER)
+		user_enter();
+}
+#else
+static inline bool context_tracking_active(void) { return false; }
+static inline void user_enter(void) { }
+static inline void user_exit(void) { }
+static inline void context_tracking_task_switch(struct task_struct *prev) { }
+static inline void vtime_account_tick(struct task_struct *tsk, int user_tick) { }
+static inline enum ctx_state exception_enter(void) { return IN_KERNEL; }
+static inline void exception_exit(enum ctx_state prev_state) { }
+#endif /* CONFIG_CONTEXT_TRACKING */
+
+#endif /* _LINUX_CONTEXT_TRACKING_H */
@@ -7,6 +7,7 @@
 #include <linux/rculist_bl.h>
 #include <linux/spinlock.h>
 #include <linux/seqlock.h>
+#include <linux/lockref.h>
 #include <linux/cache.h>
 #include <linux/rcupdate.h>
 
@@ -125,8 +126,7 @@ struct dentry {
 	unsigned char d_iname[DNAME_INLINE_LEN];	/* small names */
 
 	/* Ref lookup also touches following */
-	unsigned int d_count;		/* protected by d_lock */
-	spinlock_t d_lock;		/* per dentry lock */
+	struct lockref d_lockref;	/* per-dentry lock and refcount */
 	const struct dentry_operations *d_op;
 	struct super_block *d_sb;	/* The root of the dentry tree */
 	unsigned long d_time;		/* used by d_revalidate */
@@ -144,6 +144,8 @@ struct dentry {
 	struct list_head d_alias;	/* inode alias list */
 };
 
+#define d_lock	d_lockref.lock
+
 /*
  * dentry->d_lock spinlock nesting subclasses:
  *
@@ -310,6 +312,8 @@ extern struct dentry *__d_lookup(struct dentry *, struct qstr *);
 extern struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name,
 				unsigned *seq, struct inode **inode);
 
+extern void __d_rcu_unref(struct dentry *dentry);
+
 /**
  * __d_rcu_to_refcount - take a refcount on dentry if sequence check is ok
  * @dentry: dentry to take a ref on
@@ -317,19 +321,19 @@ extern struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name,
  * Returns: 0 on failure, else 1.
  *
  * __d_rcu_to_refcount operates on a dentry,seq pair that was returned
- * by __d_lookup_rcu, to get a reference on an rcu-walk dentry.
+ * by __d_lookup_rcu, to get a reference on an rcu-walk dentry. It does not
+ * need d_lock: the count is taken with lockref_get_not_dead() and the
+ * sequence is checked afterwards. Must be called under rcu_read_lock().
  */
 static inline int __d_rcu_to_refcount(struct dentry *dentry, unsigned seq)
 {
-	int ret = 0;
-
-	assert_spin_locked(&dentry->d_lock);
-	if (!read_seqcount_retry(&dentry->d_seq, seq)) {
-		ret = 1;
-		dentry->d_count++;
-	}
+	if (!lockref_get_not_dead(&dentry->d_lockref))
+		return 0;
+	if (likely(!read_seqcount_retry(&dentry->d_seq, seq)))
+		return 1;
 
-	return ret;
+	__d_rcu_unref(dentry);
+	return 0;
 }
 
 /* validate "insecure" dentry pointer */
@@ -359,20 +363,29 @@ extern char *dentry_path(struct dentry *, char *, int);
 static inline struct dentry *dget_dlock(struct dentry *dentry)
 {
 	if (dentry)
-		dentry->d_count++;
+		dentry->d_lockref.count++;
 	return dentry;
 }
 
 static inline struct dentry *dget(struct dentry *dentry)
 {
-	if (dentry) {
-		spin_lock(&dentry->d_lock);
-		dget_dlock(dentry);
-		spin_unlock(&dentry->d_lock);
-	}
+	if (dentry)
+		lockref_get(&dentry->d_lockref);
 	return dentry;
 }
 
+/**
+ *	d_count -	current reference count of a dentry
+ *	@dentry: dentry to look at
+ *
+ *	The value is only stable while dentry->d_lock is held; without it
+ *	the result is just a snapshot.
+ */
+static inline unsigned d_count(const struct dentry *dentry)
+{
+	return dentry->d_lockref.count;
+}
+
 extern struct dentry *dget_parent(struct dentry *dentry);
 
 /**
@@ -0,0 +1,95 @@
+/*
+ * Dynamic queue limits (dql)
+ *
+ * Limits the number of objects, typically bytes, that are queued to a
+ * consumer, typically a NIC transmit ring, to about the amount the
+ * consumer can complete in one completion interval. The queue then does
+ * not starve the consumer, and nothing beyond that amount sits in it.
+ * The backlog is left to whatever queues objects in the first place,
+ * where it can be scheduled and dropped sensibly.
+ *
+ * The limit is adapted each time completions are reported:
+ *
+ *   - if the queue was over its limit and the consumer ran out of
+ *     objects before the completion was processed, the limit was too
+ *     low: it grows by what was completed in the last interval, plus
+ *     whatever was queued over the limit;
+ *
+ *   - if the consumer was busy during the whole interval and some of
+ *     the queued objects were not needed to keep it busy ("slack"), the
+ *     limit shrinks by the smallest slack seen over the hold time.
+ *
+ * The producer calls dql_queued() with the count of objects it queues,
+ * and stops queueing when dql_avail() goes negative. The consumer calls
+ * dql_completed() with the count of objects it completed, and lets the
+ * producer go again when dql_avail() is no longer negative. Neither
+ * side takes a lock: dql_queued() and dql_completed() are only called
+ * by the producer and the consumer respectively, which must each
+ * serialize their own calls.
+ */
+#ifndef _LINUX_DQL_H
+#define _LINUX_DQL_H
+
+#ifdef __KERNEL__
+
+#include <linux/bug.h>
+#include <linux/cache.h>
+#include <linux/kernel.h>
+
+struct dql {
+	/* Fields written by the producer (dql_queued) */
+	unsigned int	num_queued;		/* total ever queued */
+	unsigned int	adj_limit;		/* limit + num_completed */
+	unsigned int	last_obj_cnt;		/* count at the last queuing */
+
+	/* Fields only accessed by the consumer (dql_completed) */
+	unsigned int	limit ____cacheline_aligned_in_smp; /* current limit */
+	unsigned int	num_completed;		/* total ever completed */
+
+	unsigned int	prev_ovlimit;		/* previous over limit */
+	unsigned int	prev_num_queued;	/* previous queue total */
+	unsigned int	prev_last_obj_cnt;	/* previous queuing count */
+
+	unsigned int	lowest_slack;		/* lowest slack found */
+	unsigned long	slack_start_time;	/* time slacks seen */
+
+	/* Configuration */
+	unsigned int	max_limit;		/* maximum limit */
+	unsigned int	min_limit;		/* minimum limit */
+	unsigned int	slack_hold_time;	/* time to measure slack */
+};
+
+/* Keep the counters from wrapping into the sign bit of dql_avail() */
+#define DQL_MAX_OBJECT	(UINT_MAX / 16)
+#define DQL_MAX_LIMIT	((UINT_MAX / 2) - DQL_MAX_OBJECT)
+
+/*
+ * Record @count objects as queued. The producer should then stop
+ * queueing if dql_avail() is negative.
+ */
+static inline void dql_queued(struct dql *dql, unsigned int count)
+{
+	BUG_ON(count > DQL_MAX_OBJECT);
+
+	dql->num_queued += count;
+	dql->last_obj_cnt = count;
+}
+
+/* Returns how many objects can be queued, < 0 indicates over limit. */
+static inline int dql_avail(const struct dql *dql)
+{
+	return dql->adj_limit - dql->num_queued;
+}
+
+/* Record @count objects as completed and adapt the limit. */
+extern void dql_completed(struct dql *dql, unsigned int count);
+
+/* Reset the dynamic state, e.g. when the consumer has been flushed. */
+extern void dql_reset(struct dql *dql);
+
+/* Initialize @dql, measuring slack over @hold_time jiffies. */
+extern int dql_init(struct dql *dql, unsigned hold_time);
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_DQL_H */
@@ -0,0 +1,132 @@
+#ifndef _LINUX_FRONTSWAP_H
+#define _LINUX_FRONTSWAP_H
+
+#include <linux/swap.h>
+#include <linux/mm.h>
+#include <linux/bitops.h>
+
+/*
+ * A frontswap backend sits in front of the swap devices: swap_writepage()
+ * offers each page to ->store() before building a bio, and swap_readpage()
+ * asks ->load() before reading from the device. A backend may refuse any
+ * store by returning non-zero, in which case the page goes to the device.
+ */
+struct frontswap_ops {
+	void (*init)(unsigned type);
+	int (*store)(unsigned type, pgoff_t offset, struct page *page);
+	int (*load)(unsigned type, pgoff_t offset, struct page *page);
+	void (*invalidate_page)(unsigned type, pgoff_t offset);
+	void (*invalidate_area)(unsigned type);
+};
+
+extern struct frontswap_ops
+	frontswap_register_ops(struct frontswap_ops *ops);
+
+extern void __frontswap_init(unsigned type);
+extern int __frontswap_store(struct page *page);
+extern int __frontswap_load(struct page *page);
+extern void __frontswap_invalidate_page(unsigned type, pgoff_t offset);
+extern void __frontswap_invalidate_area(unsigned type);
+
+#ifdef CONFIG_FRONTSWAP
+extern bool frontswap_enabled;
+
+static inline bool frontswap_test(struct swap_info_struct *sis, pgoff_t offset)
+{
+	bool ret = false;
+
+	if (frontswap_enabled && sis->frontswap_map)
+		ret = test_bit(offset, sis->frontswap_map);
+	return ret;
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *p,
+				     unsigned long *map)
+{
+	p->frontswap_map = map;
+}
+
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *p)
+{
+	return p->frontswap_map;
+}
+
+static inline int frontswap_store(struct page *page)
+{
+	int ret = -1;
+
+	if (frontswap_enabled)
+		ret = __frontswap_store(page);
+	return ret;
+}
+
+static inline int frontswap_load(struct page *page)
+{
+	int ret = -1;
+
+	if (frontswap_enabled)
+		ret = __frontswap_load(page);
+	return ret;
+}
+
+static inline void frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	if (frontswap_enabled)
+		__frontswap_invalidate_page(type, offset);
+}
+
+static inline void frontswap_invalidate_area(unsigned type)
+{
+	if (frontswap_enabled)
+		__frontswap_invalidate_area(type);
+}
+
+static inline void frontswap_init(unsigned type)
+{
+	if (frontswap_enabled)
+		__frontswap_init(type);
+}
+
+#else /* CONFIG_FRONTSWAP */
+#define frontswap_enabled (0)
+
+static inline bool frontswap_test(struct swap_info_struct *sis, pgoff_t offset)
+{
+	return false;
+}
+
+static inline void frontswap_map_set(struct swap_info_struct *p,
+				     unsigned long *map)
+{
+}
+
+static inline unsigned long *frontswap_map_get(struct swap_info_struct *p)
+{
+	return NULL;
+}
+
+static inline int frontswap_store(struct page *page)
+{
+	return -1;
+}
+
+static inline int frontswap_load(struct page *page)
+{
+	return -1;
+}
+
+static inline void frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+}
+
+static inline void frontswap_invalidate_area(unsigned type)
+{
+}
+
+static inline void frontswap_init(unsigned type)
+{
+}
+
+#endif /* CONFIG_FRONTSWAP */
+
+#endif /* _LINUX_FRONTSWAP_H */
@@ -250,6 +250,9 @@ static inline int vma_migratable(struct vm_area_struct *vma)
 	return 1;
 }
 
+extern int mpol_misplaced(struct page *, struct vm_area_struct *,
+			  unsigned long);
+
 #else
 
 struct mempolicy {};
@@ -376,6 +379,12 @@ static inline int mpol_to_str(char *buffer, int maxlen, struct mempolicy *pol,
 }
 #endif
 
+static inline int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+				 unsigned long address)
+{
+	return -1; /* no node preference */
+}
+
 #endif /* CONFIG_NUMA */
 #endif /* __KERNEL__ */
 
@@ -1557,6 +1557,37 @@ static inline pgprot_t vm_get_page_prot(unsigned long vm_flags)
 }
 #endif
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * The PROT_NONE variant of a vma's protection, used for NUMA hinting
+ * faults. The ptes keep their pfn, dirty and accessed bits.
+ */
+static inline pgprot_t vma_prot_none(struct vm_area_struct *vma)
+{
+	return vm_get_page_prot(vma->vm_flags & ~(VM_READ|VM_WRITE|VM_EXEC));
+}
+
+/*
+ * A pte is a NUMA hinting pte if the vma is accessible but the pte
+ * carries the PROT_NONE protection. A genuine PROT_NONE vma never gets
+ * here: the arch fault handler rejects the access first.
+ */
+static inline bool pte_numa(struct vm_area_struct *vma, pte_t pte)
+{
+	if (pte_same(pte, pte_modify(pte, vma->vm_page_prot)))
+		return false;
+	return pte_same(pte, pte_modify(pte, vma_prot_none(vma)));
+}
+
+extern unsigned long change_prot_numa(struct vm_area_struct *vma,
+			unsigned long start, unsigned long end);
+#else
+static inline bool pte_numa(struct vm_area_struct *vma, pte_t pte)
+{
+	return false;
+}
+#endif
+
 struct vm_area_struct *find_extend_vma(struct mm_struct *, unsigned long addr);
 int remap_pfn_range(struct vm_area_struct *, unsigned long addr,
 			unsigned long pfn, unsigned long size, pgprot_t);
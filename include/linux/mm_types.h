@@ -317,6 +317,14 @@ struct mm_struct {
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	pgtable_t pmd_huge_pte; /* protected by page_table_lock */
 #endif
+#ifdef CONFIG_NUMA_BALANCING
+	/* jiffies after which the next NUMA hinting scan may start */
+	unsigned long numa_next_scan;
+	/* address at which the next scan resumes */
+	unsigned long numa_scan_offset;
+	/* completed passes over the whole address space */
+	int numa_scan_seq;
+#endif
 };
 
 /* Future-safe accessor for struct mm_struct's cpu_vm_mask. */
@@ -18,6 +18,7 @@
 #include <asm/atomic.h>
 
 struct rw_semaphore;
+struct rwsem_spin_node;
 
 #ifdef CONFIG_RWSEM_GENERIC_SPINLOCK
 #include <linux/rwsem-spinlock.h> /* use a generic implementation */
@@ -27,11 +28,23 @@ struct rw_semaphore {
 	long			count;
 	spinlock_t		wait_lock;
 	struct list_head	wait_list;
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	/*
+	 * owner is the writer holding the semaphore, RWSEM_READER_OWNED
+	 * once readers got it, or NULL. It is only a hint for writers
+	 * spinning in rwsem_down_write_failed(), which queue up on
+	 * spin_queue so that only one of them polls the semaphore.
+	 */
+	struct thread_info	*owner;
+	struct rwsem_spin_node	*spin_queue;
+#endif
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map	dep_map;
 #endif
 };
 
+#define RWSEM_READER_OWNED	((struct thread_info *)1UL)
+
 extern struct rw_semaphore *rwsem_down_read_failed(struct rw_semaphore *sem);
 extern struct rw_semaphore *rwsem_down_write_failed(struct rw_semaphore *sem);
 extern struct rw_semaphore *rwsem_wake(struct rw_semaphore *);
@@ -34,7 +34,10 @@ enum tick_nohz_mode {
  *			timer is modified for idle sleeps. This is necessary
  *			to resume the tick timer operation in the timeline
  *			when the CPU returns from idle
- * @tick_stopped:	Indicator that the idle tick has been stopped
+ * @tick_stopped:	Indicator that the tick has been stopped, in idle or
+ *			for a single task on a full dynticks CPU
+ * @idle_stopped:	The tick was stopped from the idle loop, RCU and the
+ *			nohz load balancer have been told
  * @idle_jiffies:	jiffies at the entry to idle for idle time accounting
  * @idle_calls:		Total number of idle calls
  * @idle_sleeps:	Number of idle calls, where the sched tick was stopped
@@ -53,6 +56,7 @@ struct tick_sched {
 	ktime_t				idle_tick;
 	int				inidle;
 	int				tick_stopped;
+	int				idle_stopped;
 	unsigned long			idle_jiffies;
 	unsigned long			idle_calls;
 	unsigned long			idle_sleeps;
@@ -139,4 +143,26 @@ static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 static inline u64 get_cpu_iowait_time_us(int cpu, u64 *unused) { return -1; }
 # endif /* !NO_HZ */
 
+# ifdef CONFIG_NO_HZ_FULL
+extern bool tick_nohz_full_running;
+extern cpumask_var_t tick_nohz_full_mask;
+
+static inline bool tick_nohz_full_cpu(int cpu)
+{
+	if (!tick_nohz_full_running)
+		return false;
+
+	return cpumask_test_cpu(cpu, tick_nohz_full_mask);
+}
+
+extern void tick_nohz_irq_exit(void);
+extern void tick_nohz_full_kick_cpu(int cpu);
+extern void tick_nohz_full_kick_all(void);
+# else
+static inline bool tick_nohz_full_cpu(int cpu) { return false; }
+static inline void tick_nohz_irq_exit(void) { }
+static inline void tick_nohz_full_kick_cpu(int cpu) { }
+static inline void tick_nohz_full_kick_all(void) { }
+# endif /* !NO_HZ_FULL */
+
 #endif
@@ -105,12 +105,36 @@ struct listen_sock {
 	struct request_sock	*syn_table[0];
 };
 
+/*
+ * TCP Fast Open state of a listener:
+ *	lock - protects the request_socks co-owned by the listener and the
+ *		child sockets, see reqsk_fastopen_remove().
+ *	qlen - pending TFO requests (children still in TCP_SYN_RECV).
+ *	max_qlen - max TFO requests allowed before TFO is disabled.
+ *
+ * This lives in request_sock_queue rather than in listen_sock because
+ * listen_sock is freed when the listener is stopped, while the children
+ * keep accessing these fields until the last of them completes its 3WHS.
+ * The children hold a reference on the listener socket for that purpose.
+ */
+struct fastopen_queue {
+	struct request_sock	*rskq_rst_head; /* Keep track of past TFO */
+	struct request_sock	*rskq_rst_tail; /* requests that caused RST.
+						 * This is part of the defense
+						 * against spoofing attack.
+						 */
+	spinlock_t	lock;
+	int		qlen;		/* # of pending (TCP_SYN_RECV) reqs */
+	int		max_qlen;	/* != 0 iff TFO is currently enabled */
+};
+
 /** struct request_sock_queue - queue of request_socks
  *
  * @rskq_accept_head - FIFO head of established children
  * @rskq_accept_tail - FIFO tail of established children
  * @rskq_defer_accept - User waits for some data after accept()
  * @syn_wait_lock - serializer
+ * @fastopenq - TCP Fast Open state, see struct fastopen_queue
  *
  * %syn_wait_lock is necessary only to avoid proc interface having to grab the main
  * lock sock while browsing the listening hash (otherwise it's deadlock prone).
@@ -128,6 +152,7 @@ struct request_sock_queue {
 	u8			rskq_defer_accept;
 	/* 3 bytes hole, try to pack */
 	struct listen_sock	*listen_opt;
+	struct fastopen_queue	fastopenq;
 };
 
 extern int reqsk_queue_alloc(struct request_sock_queue *queue,
@@ -135,6 +160,8 @@ extern int reqsk_queue_alloc(struct request_sock_queue *queue,
 
 extern void __reqsk_queue_destroy(struct request_sock_queue *queue);
 extern void reqsk_queue_destroy(struct request_sock_queue *queue);
+extern void reqsk_fastopen_remove(struct sock *sk,
+				  struct request_sock *req, bool reset);
 
 static inline struct request_sock *
 	reqsk_queue_yank_acceptq(struct request_sock_queue *queue)
@@ -838,8 +838,10 @@ static void cgroup_diput(struct dentry *dentry, struct inode *inode)
 		/*
 		 * Release the subsystem state objects.
 		 */
-		for_each_subsys(cgrp->root, ss)
+		for_each_subsys(cgrp->root, ss) {
+			percpu_ref_exit(&cgrp->subsys[ss->subsys_id]->refcnt);
 			ss->destroy(ss, cgrp);
+		}
 
 		cgrp->root->number_of_cgroups--;
 		mutex_unlock(&cgroup_mutex);
@@ -3054,6 +3056,31 @@ static int cgroup_procs_open(struct inode *unused, struct file *file)
 	return cgroup_pidlist_open(file, CGROUP_FILE_PROCS);
 }
 
+/*
+ * css refcounts only keep the exact count, and __css_put() only notices
+ * it dropping to 1, while they are in atomic mode. Switch the states of
+ * @cgrp to atomic mode while rmdir or notify_on_release need that, and
+ * back to percpu mode when nobody does. A sleeping rmdir still needs
+ * atomic mode after dropping cgroup_mutex, so CGRP_WAIT_ON_RMDIR keeps
+ * the refs there. Call with cgroup_mutex held.
+ */
+static void cgroup_css_refs_atomic(struct cgroup *cgrp, bool atomic)
+{
+	struct cgroup_subsys *ss;
+
+	for_each_subsys(cgrp->root, ss) {
+		struct cgroup_subsys_state *css = cgrp->subsys[ss->subsys_id];
+
+		if (test_bit(CSS_ROOT, &css->flags) || css_is_removed(css))
+			continue;
+		if (atomic)
+			percpu_ref_switch_to_atomic_sync(&css->refcnt);
+		else if (!notify_on_release(cgrp) &&
+			 !test_bit(CGRP_WAIT_ON_RMDIR, &cgrp->flags))
+			percpu_ref_switch_to_percpu(&css->refcnt);
+	}
+}
+
 static u64 cgroup_read_notify_on_release(struct cgroup *cgrp,
 					    struct cftype *cft)
 {
@@ -3064,11 +3091,15 @@ static int cgroup_write_notify_on_release(struct cgroup *cgrp,
 					  struct cftype *cft,
 					  u64 val)
 {
+	mutex_lock(&cgroup_mutex);
 	clear_bit(CGRP_RELEASABLE, &cgrp->flags);
 	if (val)
 		set_bit(CGRP_NOTIFY_ON_RELEASE, &cgrp->flags);
 	else
 		clear_bit(CGRP_NOTIFY_ON_RELEASE, &cgrp->flags);
+	/* __css_put() can only spot the last reference in atomic mode */
+	cgroup_css_refs_atomic(cgrp, val);
+	mutex_unlock(&cgroup_mutex);
 	return 0;
 }
 
@@ -3336,18 +3367,33 @@ static int cgroup_populate_dir(struct cgroup *cgrp)
 	return 0;
 }
 
-static void init_cgroup_css(struct cgroup_subsys_state *css,
+static void css_release(struct percpu_ref *ref)
+{
+	/* only cgroup_clear_css_refs() may drop the base reference */
+	WARN_ON_ONCE(1);
+}
+
+static int init_cgroup_css(struct cgroup_subsys_state *css,
 			       struct cgroup_subsys *ss,
 			       struct cgroup *cgrp)
 {
 	css->cgroup = cgrp;
-	atomic_set(&css->refcnt, 1);
 	css->flags = 0;
 	css->id = NULL;
-	if (cgrp == dummytop)
-		set_bit(CSS_ROOT, &css->flags);
 	BUG_ON(cgrp->subsys[ss->subsys_id]);
 	cgrp->subsys[ss->subsys_id] = css;
+
+	/*
+	 * The root state isn't reference counted, and may be set up
+	 * before the percpu allocator is.
+	 */
+	if (cgrp == dummytop) {
+		set_bit(CSS_ROOT, &css->flags);
+		return 0;
+	}
+	return percpu_ref_init(&css->refcnt, css_release,
+			       notify_on_release(cgrp) ?
+			       PERCPU_REF_INIT_ATOMIC : 0);
 }
 
 static void cgroup_lock_hierarchy(struct cgroupfs_root *root)
@@ -3430,7 +3476,9 @@ static long cgroup_create(struct cgroup *parent, struct dentry *dentry,
 			err = PTR_ERR(css);
 			goto err_destroy;
 		}
-		init_cgroup_css(css, ss, cgrp);
+		err = init_cgroup_css(css, ss, cgrp);
+		if (err)
+			goto err_destroy;
 		if (ss->use_id) {
 			err = alloc_css_id(ss, parent, cgrp);
 			if (err)
@@ -3471,8 +3519,10 @@ static long cgroup_create(struct cgroup *parent, struct dentry *dentry,
  err_destroy:
 
 	for_each_subsys(root, ss) {
-		if (cgrp->subsys[ss->subsys_id])
+		if (cgrp->subsys[ss->subsys_id]) {
+			percpu_ref_exit(&cgrp->subsys[ss->subsys_id]->refcnt);
 			ss->destroy(ss, cgrp);
+		}
 	}
 
 	mutex_unlock(&cgroup_mutex);
@@ -3516,13 +3566,16 @@ static int cgroup_has_css_refs(struct cgroup *cgrp)
 		if (ss == NULL || ss->root != cgrp->root)
 			continue;
 		css = cgrp->subsys[ss->subsys_id];
+		if (!css || test_bit(CSS_ROOT, &css->flags))
+			continue;
 		/* When called from check_for_release() it's possible
 		 * that by this point the cgroup has been removed
 		 * and the css deleted. But a false-positive doesn't
 		 * matter, since it can only happen if the cgroup
 		 * has been deleted and hence no longer needs the
-		 * release agent to be called anyway. */
-		if (css && (atomic_read(&css->refcnt) > 1))
+		 * release agent to be called anyway. A count that
+		 * isn't known, in percpu mode, counts as busy. */
+		if (percpu_ref_count_atomic(&css->refcnt) != 1)
 			return 1;
 	}
 	return 0;
@@ -3531,7 +3584,8 @@ static int cgroup_has_css_refs(struct cgroup *cgrp)
 /*
  * Atomically mark all (or else none) of the cgroup's CSS objects as
  * CSS_REMOVED. Return true on success, or false if the cgroup has
- * busy subsystems. Call with cgroup_mutex held
+ * busy subsystems. Call with cgroup_mutex held, and with the CSS
+ * refcounts in atomic mode.
  */
 
 static int cgroup_clear_css_refs(struct cgroup *cgrp)
@@ -3542,11 +3596,11 @@ static int cgroup_clear_css_refs(struct cgroup *cgrp)
 	local_irq_save(flags);
 	for_each_subsys(cgrp->root, ss) {
 		struct cgroup_subsys_state *css = cgrp->subsys[ss->subsys_id];
-		int refcnt;
+		long refcnt;
 		while (1) {
 			/* We can only remove a CSS with a refcnt==1 */
-			refcnt = atomic_read(&css->refcnt);
-			if (refcnt > 1) {
+			refcnt = percpu_ref_count_atomic(&css->refcnt);
+			if (refcnt > 1 || refcnt < 0) {
 				failed = true;
 				goto done;
 			}
@@ -3557,7 +3611,8 @@ static int cgroup_clear_css_refs(struct cgroup *cgrp)
 			 * css_tryget() to spin until we set the
 			 * CSS_REMOVED bits or abort
 			 */
-			if (atomic_cmpxchg(&css->refcnt, refcnt, 0) == refcnt)
+			if (atomic_long_cmpxchg(&css->refcnt.count,
+						refcnt, 0) == refcnt)
 				break;
 			cpu_relax();
 		}
@@ -3570,8 +3625,8 @@ static int cgroup_clear_css_refs(struct cgroup *cgrp)
 			 * Restore old refcnt if we previously managed
 			 * to clear it from 1 to 0
 			 */
-			if (!atomic_read(&css->refcnt))
-				atomic_set(&css->refcnt, 1);
+			if (!atomic_long_read(&css->refcnt.count))
+				atomic_long_set(&css->refcnt.count, 1);
 		} else {
 			/* Commit the fact that the CSS is removed */
 			set_bit(CSS_REMOVED, &css->flags);
@@ -3631,6 +3686,7 @@ again:
 		mutex_unlock(&cgroup_mutex);
 		return -EBUSY;
 	}
+	cgroup_css_refs_atomic(cgrp, true);
 	prepare_to_wait(&cgroup_rmdir_waitq, &wait, TASK_INTERRUPTIBLE);
 	if (!cgroup_clear_css_refs(cgrp)) {
 		mutex_unlock(&cgroup_mutex);
@@ -3642,6 +3698,10 @@ again:
 			schedule();
 		finish_wait(&cgroup_rmdir_waitq, &wait);
 		clear_bit(CGRP_WAIT_ON_RMDIR, &cgrp->flags);
+
+		mutex_lock(&cgroup_mutex);
+		cgroup_css_refs_atomic(cgrp, false);
+		mutex_unlock(&cgroup_mutex);
 		if (signal_pending(current))
 			return -EINTR;
 		goto again;
@@ -4439,9 +4499,11 @@ static void check_for_release(struct cgroup *cgrp)
 void __css_put(struct cgroup_subsys_state *css, int count)
 {
 	struct cgroup *cgrp = css->cgroup;
-	int val;
+	long val;
 	rcu_read_lock();
-	val = atomic_sub_return(count, &css->refcnt);
+	percpu_ref_put_many(&css->refcnt, count);
+	/* -1 in percpu mode, when nobody waits for the count to drop */
+	val = percpu_ref_count_atomic(&css->refcnt);
 	if (val == 1) {
 		if (notify_on_release(cgrp)) {
 			set_bit(CGRP_RELEASABLE, &cgrp->flags);
@@ -4450,7 +4512,6 @@ void __css_put(struct cgroup_subsys_state *css, int count)
 		cgroup_wakeup_rmdir_waiter(cgrp);
 	}
 	rcu_read_unlock();
-	WARN_ON_ONCE(val < 1);
 }
 EXPORT_SYMBOL_GPL(__css_put);
 
@@ -4570,7 +4631,8 @@ unsigned short css_id(struct cgroup_subsys_state *css)
 	 * it's unchanged until freed.
 	 */
 	cssid = rcu_dereference_check(css->id,
-			rcu_read_lock_held() || atomic_read(&css->refcnt));
+			rcu_read_lock_held() || test_bit(CSS_ROOT, &css->flags) ||
+			!percpu_ref_is_zero(&css->refcnt));
 
 	if (cssid)
 		return cssid->id;
@@ -4583,7 +4645,8 @@ unsigned short css_depth(struct cgroup_subsys_state *css)
 	struct css_id *cssid;
 
 	cssid = rcu_dereference_check(css->id,
-			rcu_read_lock_held() || atomic_read(&css->refcnt));
+			rcu_read_lock_held() || test_bit(CSS_ROOT, &css->flags) ||
+			!percpu_ref_is_zero(&css->refcnt));
 
 	if (cssid)
 		return cssid->depth;
@@ -0,0 +1,143 @@
+/*
+ * Context tracking: probes on the kernel/user boundary
+ *
+ * A cpu that runs userspace code without the tick has to tell RCU that
+ * it is in an extended quiescent state while it does so, and cannot
+ * rely on the tick to sample its cputime. Both are done here, when the
+ * architecture reports that the cpu is crossing the boundary.
+ *
+ * Cputime is accounted in jiffies: the time since the last boundary is
+ * charged as user or system time to the task that crossed it. Whatever
+ * the tick would have sampled is thus accounted at the next crossing,
+ * at the next context switch or at the next tick that does happen.
+ *
+ * Distribute under GPLv2.
+ */
+
+#include <linux/context_tracking.h>
+#include <linux/hardirq.h>
+#include <linux/jiffies.h>
+#include <linux/kernel_stat.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
+
+DEFINE_PER_CPU(struct context_tracking, context_tracking);
+
+/**
+ * context_tracking_cpu_set - activate the probes on a cpu
+ * @cpu: cpu to track
+ *
+ * Must be called at boot time, before any other task than the boot
+ * idle task exists: TIF_NOHZ, which routes syscalls through the slow
+ * paths that call the probes, is inherited by every task forked from
+ * it.
+ */
+void __init context_tracking_cpu_set(int cpu)
+{
+	per_cpu(context_tracking, cpu).active = true;
+	per_cpu(context_tracking, cpu).vtime_snap = jiffies;
+	set_tsk_thread_flag(&init_task, TIF_NOHZ);
+}
+
+static void vtime_account(struct task_struct *tsk, bool user,
+			  int hardirq_offset)
+{
+	unsigned long now = jiffies;
+	unsigned long delta = now - __this_cpu_read(context_tracking.vtime_snap);
+	cputime_t cputime;
+
+	if (!delta)
+		return;
+
+	__this_cpu_write(context_tracking.vtime_snap, now);
+
+	cputime = jiffies_to_cputime(delta);
+	if (user)
+		account_user_time(tsk, cputime, cputime_to_scaled(cputime));
+	else
+		account_system_time(tsk, hardirq_offset, cputime,
+				    cputime_to_scaled(cputime));
+}
+
+/**
+ * user_enter - the current task is about to return to userspace
+ *
+ * Accounts the time spent in the kernel since the last boundary and
+ * puts the cpu in an RCU extended quiescent state: no RCU read side
+ * critical section may run after this, until user_exit().
+ */
+void user_enter(void)
+{
+	unsigned long flags;
+
+	/*
+	 * An exception taken inside an interrupt must not touch the
+	 * state, rcu_irq_enter() already protects whatever runs there.
+	 */
+	if (in_interrupt())
+		return;
+
+	local_irq_save(flags);
+	if (__this_cpu_read(context_tracking.active) &&
+	    __this_cpu_read(context_tracking.state) != IN_USER) {
+		vtime_account(current, false, 0);
+		__this_cpu_write(context_tracking.state, IN_USER);
+		rcu_enter_nohz();
+	}
+	local_irq_restore(flags);
+}
+
+/**
+ * user_exit - the current task entered the kernel from userspace
+ *
+ * Leaves the RCU extended quiescent state and accounts the time spent
+ * in userspace since the last boundary. Calling it while already in
+ * the kernel is harmless.
+ */
+void user_exit(void)
+{
+	unsigned long flags;
+
+	if (in_interrupt())
+		return;
+
+	local_irq_save(flags);
+	if (__this_cpu_read(context_tracking.state) == IN_USER) {
+		rcu_exit_nohz();
+		__this_cpu_write(context_tracking.state, IN_KERNEL);
+		vtime_account(current, true, 0);
+	}
+	local_irq_restore(flags);
+}
+
+/**
+ * context_tracking_task_switch - account the task that was switched out
+ * @prev: the task that ran before current
+ *
+ * Context switches happen in the kernel: what @prev did since its last
+ * boundary is system time, and current starts a new period.
+ */
+void context_tracking_task_switch(struct task_struct *prev)
+{
+	if (!__this_cpu_read(context_tracking.active))
+		return;
+
+	if (prev != idle_task(smp_processor_id()))
+		vtime_account(prev, false, 0);
+	else
+		__this_cpu_write(context_tracking.vtime_snap, jiffies);
+}
+
+/**
+ * vtime_account_tick - account a task from the tick on a tracked cpu
+ * @tsk: the task that was running, never the idle task
+ * @user_tick: whether the tick interrupted userspace
+ *
+ * The tick, when it runs, accounts what is pending since the last
+ * boundary instead of sampling a jiffy, so that cputime stays current
+ * for a task that spends a long time in userspace.
+ */
+void vtime_account_tick(struct task_struct *tsk, int user_tick)
+{
+	vtime_account(tsk, user_tick, HARDIRQ_OFFSET);
+}
@@ -2394,6 +2394,15 @@ void perf_event_task_tick(void)
 	}
 }
 
+/*
+ * Multiplexed events are rotated from the tick, a cpu that has some
+ * can't go without it.
+ */
+bool perf_event_can_stop_tick(void)
+{
+	return list_empty(&__get_cpu_var(rotation_list));
+}
+
 static int event_enable_on_exec(struct perf_event *event,
 				struct perf_event_context *ctx)
 {
@@ -8,6 +8,7 @@
 #include <linux/math64.h>
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
+#include <linux/tick.h>
 #include <trace/events/timer.h>
 
 /*
@@ -597,6 +598,9 @@ static void arm_timer(struct k_itimer *timer)
 				cputime_expires->sched_exp = exp->sched;
 			break;
 		}
+
+		/* the task may be on a cpu running without the tick */
+		tick_nohz_full_kick_all();
 	}
 }
 
@@ -1300,6 +1304,24 @@ static inline int fastpath_timer_check(struct task_struct *tsk)
 	return 0;
 }
 
+/**
+ * posix_cpu_timers_can_stop_tick - check whether a task needs the tick
+ * @tsk:	The task running on the cpu.
+ *
+ * The timers of @tsk and of its thread group are run from the tick, it
+ * can't be stopped while any of them is armed.
+ */
+bool posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return false;
+
+	if (tsk->signal->cputimer.running)
+		return false;
+
+	return true;
+}
+
 /*
  * This is called from the timer interrupt handler.  The irq handler has
  * already updated our counts.  We need to check if any timers fire now.
@@ -1415,6 +1437,8 @@ void set_process_cpu_timer(struct task_struct *tsk, unsigned int clock_idx,
 			tsk->signal->cputime_expires.virt_exp = *newval;
 		break;
 	}
+
+	tick_nohz_full_kick_all();
 }
 
 static int do_cpu_nanosleep(const clockid_t which_clock, int flags,
@@ -26,6 +26,9 @@
 
 #include <linux/delay.h>
 #include <linux/stop_machine.h>
+#include <linux/bootmem.h>
+#include <linux/kthread.h>
+#include <linux/tick.h>
 
 /*
  * Check the RCU kernel configuration parameters and print informative
@@ -68,7 +71,8 @@ static void __init rcu_bootup_announce_oddness(void)
 
 #ifdef CONFIG_TREE_PREEMPT_RCU
 
-struct rcu_state rcu_preempt_state = RCU_STATE_INITIALIZER(rcu_preempt_state);
+struct rcu_state rcu_preempt_state =
+	RCU_STATE_INITIALIZER(rcu_preempt_state, 'p');
 DEFINE_PER_CPU(struct rcu_data, rcu_preempt_data);
 
 static int rcu_preempted_readers_exp(struct rcu_node *rnp);
@@ -550,7 +554,7 @@ static void rcu_preempt_process_callbacks(void)
  */
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state);
+	__call_rcu(head, func, &rcu_preempt_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -1260,3 +1264,286 @@ static void rcu_needs_cpu_flush(void)
 }
 
 #endif /* #else #if !defined(CONFIG_RCU_FAST_NO_HZ) */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback invocation from no-CBs CPUs.  The callbacks queued
+ * on such a CPU are handed to a per-CPU, per-flavor "rcuo" kthread,
+ * which waits for a grace period and invokes them.  The kthreads are
+ * not bound to any CPU, so they can be moved to housekeeping CPUs,
+ * leaving the no-CBs CPUs free of both softirq callback invocation
+ * and of the scheduling-clock interrupts needed to drive it.
+ */
+
+static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
+static bool rcu_nocb_poll;	    /* Offload kthreads are to poll. */
+
+/* Parse the boot-time rcu_nocbs= CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+static int __init parse_rcu_nocb_poll(char *arg)
+{
+	rcu_nocb_poll = true;
+	return 1;
+}
+__setup("rcu_nocb_poll", parse_rcu_nocb_poll);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Enqueue the specified callback onto the specified CPU's no-CBs list,
+ * returning false if that CPU is not a no-CBs CPU.  The enqueue is
+ * lockless: concurrent enqueuers serialize on the xchg() of the tail
+ * pointer, and the first one to hit an empty list wakes the kthread.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp)
+{
+	struct rcu_head **old_rhpp;
+	struct task_struct *t;
+
+	if (!is_nocb_cpu(rdp->cpu))
+		return false;
+
+	old_rhpp = xchg(&rdp->nocb_tail, &rhp->next);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	atomic_long_inc(&rdp->nocb_q_count);
+
+	/* If we are not being polled and there is a kthread, awaken it. */
+	t = ACCESS_ONCE(rdp->nocb_kthread);
+	if (rcu_nocb_poll || !t)
+		return true;
+	if (old_rhpp == &rdp->nocb_head)
+		wake_up(&rdp->nocb_wq); /* ... only if queue was empty ... */
+	return true;
+}
+
+/*
+ * Queue rcu_barrier() callbacks directly onto the no-CBs lists, for
+ * offline CPUs as well: their kthreads keep running, and invoke the
+ * barrier callbacks after the callbacks that were queued before them.
+ */
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+	struct rcu_head *head;
+	int cpu;
+
+	if (!have_rcu_nocb_mask)
+		return;
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		head = &per_cpu(rcu_barrier_head, cpu);
+		debug_rcu_head_queue(head);
+		head->func = rcu_barrier_callback;
+		head->next = NULL;
+		atomic_inc(&rcu_barrier_cpu_count);
+		smp_mb(); /* Count the callback before it can be invoked. */
+		__call_rcu_nocb(per_cpu_ptr(rsp->rda, cpu), head);
+	}
+}
+
+/*
+ * Wait for a grace period by queueing a callback of the right flavor
+ * on the CPU the kthread happens to run on, bypassing offloading.
+ */
+static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+{
+	struct rcu_synchronize rcu;
+
+	init_rcu_head_on_stack(&rcu.head);
+	init_completion(&rcu.completion);
+	__call_rcu(&rcu.head, wakeme_after_rcu, rdp->rsp, false);
+
+	/* Sleep interruptibly so as not to inflate the load average. */
+	while (wait_for_completion_interruptible(&rcu.completion))
+		flush_signals(current);
+	destroy_rcu_head_on_stack(&rcu.head);
+}
+
+/*
+ * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
+ * callbacks queued by the corresponding no-CBs CPU.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	long c;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	struct rcu_data *rdp = arg;
+
+	/* Each pass through this loop invokes one batch of callbacks */
+	for (;;) {
+		/* If not polling, wait for next batch of callbacks. */
+		if (!rcu_nocb_poll)
+			wait_event_interruptible(rdp->nocb_wq,
+						 ACCESS_ONCE(rdp->nocb_head));
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list) {
+			schedule_timeout_interruptible(1);
+			continue;
+		}
+
+		/*
+		 * Extract queued callbacks, update counts, and wait
+		 * for a grace period to elapse.
+		 */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		c = atomic_long_xchg(&rdp->nocb_q_count, 0);
+		ACCESS_ONCE(rdp->nocb_p_count) += c;
+		rcu_nocb_wait_gp(rdp);
+
+		/* Each pass through the following loop invokes a callback. */
+		c = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for enqueuing to complete, if needed. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = list->next;
+			}
+			debug_rcu_head_unqueue(list);
+			/* Callbacks expect the softirq context of rcu_do_batch(). */
+			local_bh_disable();
+			list->func(list);
+			local_bh_enable();
+			list = next;
+			c++;
+			cond_resched();
+		}
+		ACCESS_ONCE(rdp->nocb_p_count) -= c;
+		rdp->n_cbs_invoked += c;
+	}
+	return 0;
+}
+
+/* Initialize per-rcu_data variables for no-CBs CPUs. */
+static void rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_waitqueue_head(&rdp->nocb_wq);
+}
+
+/*
+ * Set up the no-CBs CPU mask at boot: full dynticks CPUs are always
+ * no-CBs CPUs, and the boot CPU never is, so that grace periods and
+ * the rcuo kthreads have somewhere to run.
+ */
+static void __init rcu_init_nocb(void)
+{
+	static char nocb_buf[NR_CPUS * 5] __initdata;
+	int cpu = smp_processor_id();
+
+#ifdef CONFIG_NO_HZ_FULL
+	if (tick_nohz_full_running) {
+		if (!have_rcu_nocb_mask) {
+			/* The slab allocator is up by now, bootmem is not. */
+			if (!zalloc_cpumask_var(&rcu_nocb_mask, GFP_NOWAIT)) {
+				printk(KERN_WARNING "\tNo memory for no-CBs "
+				       "CPU mask, callbacks not offloaded.\n");
+				return;
+			}
+			have_rcu_nocb_mask = true;
+		}
+		cpumask_or(rcu_nocb_mask, rcu_nocb_mask, tick_nohz_full_mask);
+	}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+	if (!have_rcu_nocb_mask)
+		return;
+	cpumask_and(rcu_nocb_mask, rcu_nocb_mask, cpu_possible_mask);
+	if (cpumask_test_cpu(cpu, rcu_nocb_mask)) {
+		printk(KERN_INFO "\tBoot CPU %d cannot be a no-CBs CPU.\n", cpu);
+		cpumask_clear_cpu(cpu, rcu_nocb_mask);
+	}
+	if (cpumask_empty(rcu_nocb_mask)) {
+		have_rcu_nocb_mask = false;
+		return;
+	}
+	cpulist_scnprintf(nocb_buf, sizeof(nocb_buf), rcu_nocb_mask);
+	printk(KERN_INFO "\tOffload RCU callbacks from CPUs: %s.\n", nocb_buf);
+	if (rcu_nocb_poll)
+		printk(KERN_INFO "\tPoll for callbacks from no-CBs CPUs.\n");
+}
+
+/* Create a kthread for each RCU flavor for each no-CBs CPU. */
+static void __init rcu_spawn_nocb_kthreads(struct rcu_state *rsp,
+					   const struct cpumask *housekeeping)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct task_struct *t;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		t = kthread_create(rcu_nocb_kthread, rdp,
+				   "rcuo%c/%d", rsp->abbr, cpu);
+		BUG_ON(IS_ERR(t));
+		set_cpus_allowed_ptr(t, housekeeping);
+		wake_up_process(t);
+		ACCESS_ONCE(rdp->nocb_kthread) = t;
+	}
+}
+
+/*
+ * Spawn the rcuo kthreads, affine to the CPUs that are not no-CBs CPUs
+ * by default.  Callbacks queued before this are picked up as soon as
+ * the kthreads start.
+ */
+static int __init rcu_spawn_nocb(void)
+{
+	cpumask_var_t housekeeping;
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+	if (!zalloc_cpumask_var(&housekeeping, GFP_KERNEL))
+		return -ENOMEM;
+	cpumask_andnot(housekeeping, cpu_possible_mask, rcu_nocb_mask);
+	rcu_spawn_nocb_kthreads(&rcu_sched_state, housekeeping);
+	rcu_spawn_nocb_kthreads(&rcu_bh_state, housekeeping);
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	rcu_spawn_nocb_kthreads(&rcu_preempt_state, housekeeping);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+	free_cpumask_var(housekeeping);
+	return 0;
+}
+early_initcall(rcu_spawn_nocb);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp)
+{
+	return false;
+}
+
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+}
+
+static void rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+static void __init rcu_init_nocb(void)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
@@ -65,6 +65,10 @@ static void print_one_rcu_data(struct seq_file *m, struct rcu_data *rdp)
 #endif /* #ifdef CONFIG_NO_HZ */
 	seq_printf(m, " of=%lu ri=%lu", rdp->offline_fqs, rdp->resched_ipi);
 	seq_printf(m, " ql=%ld b=%ld", rdp->qlen, rdp->blimit);
+#ifdef CONFIG_RCU_NOCB_CPU
+	seq_printf(m, " nq=%ld np=%ld",
+		   atomic_long_read(&rdp->nocb_q_count), rdp->nocb_p_count);
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 	seq_printf(m, " ci=%lu co=%lu ca=%lu\n",
 		   rdp->n_cbs_invoked, rdp->n_cbs_orphaned, rdp->n_cbs_adopted);
 }
@@ -28,6 +28,9 @@
 #define CREATE_TRACE_POINTS
 #include <trace/events/irq.h>
 
+EXPORT_TRACEPOINT_SYMBOL_GPL(softirq_entry);
+EXPORT_TRACEPOINT_SYMBOL_GPL(softirq_exit);
+
 #include <asm/irq.h>
 /*
    - No shared variables, all the data are CPU local.
@@ -339,6 +342,10 @@ void irq_exit(void)
 	if (!in_interrupt() && local_softirq_pending())
 		invoke_softirq();
 
+	/* A full dynticks cpu may stop or need its tick again */
+	if (!in_interrupt())
+		tick_nohz_irq_exit();
+
 	rcu_irq_exit();
 #ifdef CONFIG_NO_HZ
 	/* Make sure that timer wheel updates are propagated */
@@ -11,12 +11,16 @@
  *
  *  Distribute under GPLv2.
  */
+#include <linux/context_tracking.h>
 #include <linux/cpu.h>
 #include <linux/err.h>
 #include <linux/hrtimer.h>
 #include <linux/interrupt.h>
+#include <linux/irq_work.h>
 #include <linux/kernel_stat.h>
 #include <linux/percpu.h>
+#include <linux/perf_event.h>
+#include <linux/posix-timers.h>
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/module.h>
@@ -247,74 +251,21 @@ u64 get_cpu_iowait_time_us(int cpu, u64 *last_update_time)
 }
 EXPORT_SYMBOL_GPL(get_cpu_iowait_time_us);
 
-/**
- * tick_nohz_stop_sched_tick - stop the idle tick from the idle task
+/*
+ * Stop the tick, or reprogram it if it is stopped already, until the
+ * next event this cpu has to handle. Does nothing when that event is
+ * the next tick. Must be called with interrupts disabled.
  *
- * When the next event is more than a tick into the future, stop the idle tick
- * Called either from the idle loop or from irq_exit() when an idle period was
- * just interrupted by an interrupt which did not cause a reschedule.
+ * Returns the expiry time the tick was programmed to, or zero when it
+ * was left alone.
  */
-void tick_nohz_stop_sched_tick(int inidle)
+static ktime_t tick_nohz_stop_tick(struct tick_sched *ts, ktime_t now, int cpu)
 {
-	unsigned long seq, last_jiffies, next_jiffies, delta_jiffies, flags;
-	struct tick_sched *ts;
-	ktime_t last_update, expires, now;
+	unsigned long seq, last_jiffies, next_jiffies, delta_jiffies;
+	ktime_t last_update, expires, ret = { .tv64 = 0 };
 	struct clock_event_device *dev = __get_cpu_var(tick_cpu_device).evtdev;
 	u64 time_delta;
-	int cpu;
-
-	local_irq_save(flags);
-
-	cpu = smp_processor_id();
-	ts = &per_cpu(tick_cpu_sched, cpu);
-
-	/*
-	 * Call to tick_nohz_start_idle stops the last_update_time from being
-	 * updated. Thus, it must not be called in the event we are called from
-	 * irq_exit() with the prior state different than idle.
-	 */
-	if (!inidle && !ts->inidle)
-		goto end;
-
-	/*
-	 * Set ts->inidle unconditionally. Even if the system did not
-	 * switch to NOHZ mode the cpu frequency governers rely on the
-	 * update of the idle time accounting in tick_nohz_start_idle().
-	 */
-	ts->inidle = 1;
-
-	now = tick_nohz_start_idle(cpu, ts);
-
-	/*
-	 * If this cpu is offline and it is the one which updates
-	 * jiffies, then give up the assignment and let it be taken by
-	 * the cpu which runs the tick timer next. If we don't drop
-	 * this here the jiffies might be stale and do_timer() never
-	 * invoked.
-	 */
-	if (unlikely(!cpu_online(cpu))) {
-		if (cpu == tick_do_timer_cpu)
-			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
-	}
-
-	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
-		goto end;
-
-	if (need_resched())
-		goto end;
-
-	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
-		static int ratelimit;
-
-		if (ratelimit < 10) {
-			printk(KERN_ERR "NOHZ: local_softirq_pending %02x\n",
-			       (unsigned int) local_softirq_pending());
-			ratelimit++;
-		}
-		goto end;
-	}
 
-	ts->idle_calls++;
 	/* Read jiffies and the time when jiffies were updated last */
 	do {
 		seq = read_seqbegin(&xtime_lock);
@@ -365,6 +316,13 @@ void tick_nohz_stop_sched_tick(int inidle)
 			time_delta = KTIME_MAX;
 		}
 
+#ifdef CONFIG_NO_HZ_FULL
+		/* A busy cpu still runs the scheduler tick now and then */
+		if (!ts->inidle)
+			time_delta = min(time_delta,
+					 scheduler_tick_max_deferment());
+#endif
+
 		/*
 		 * calculate the expiry time for the next timer wheel
 		 * timer. delta_jiffies >= NEXT_TIMER_MAX_DELTA signals
@@ -404,18 +362,11 @@ void tick_nohz_stop_sched_tick(int inidle)
 		 * the scheduler tick in nohz_restart_sched_tick.
 		 */
 		if (!ts->tick_stopped) {
-			select_nohz_load_balancer(1);
-
 			ts->idle_tick = hrtimer_get_expires(&ts->sched_timer);
 			ts->tick_stopped = 1;
-			ts->idle_jiffies = last_jiffies;
-			rcu_enter_nohz();
 		}
 
-		ts->idle_sleeps++;
-
-		/* Mark expires */
-		ts->idle_expires = expires;
+		ret = expires;
 
 		/*
 		 * If the expiration time == KTIME_MAX, then
@@ -448,6 +399,108 @@ out:
 	ts->next_jiffies = next_jiffies;
 	ts->last_jiffies = last_jiffies;
 	ts->sleep_length = ktime_sub(dev->next_event, now);
+
+	return ret;
+}
+
+/**
+ * tick_nohz_stop_sched_tick - stop the idle tick from the idle task
+ *
+ * When the next event is more than a tick into the future, stop the idle tick
+ * Called either from the idle loop or from irq_exit() when an idle period was
+ * just interrupted by an interrupt which did not cause a reschedule.
+ */
+void tick_nohz_stop_sched_tick(int inidle)
+{
+	struct tick_sched *ts;
+	ktime_t expires, now;
+	unsigned long flags;
+	int cpu;
+
+	local_irq_save(flags);
+
+	cpu = smp_processor_id();
+	ts = &per_cpu(tick_cpu_sched, cpu);
+
+	/*
+	 * Call to tick_nohz_start_idle stops the last_update_time from being
+	 * updated. Thus, it must not be called in the event we are called from
+	 * irq_exit() with the prior state different than idle.
+	 */
+	if (!inidle && !ts->inidle)
+		goto end;
+
+	/*
+	 * Set ts->inidle unconditionally. Even if the system did not
+	 * switch to NOHZ mode the cpu frequency governers rely on the
+	 * update of the idle time accounting in tick_nohz_start_idle().
+	 */
+	ts->inidle = 1;
+
+	now = tick_nohz_start_idle(cpu, ts);
+
+	/*
+	 * If this cpu is offline and it is the one which updates
+	 * jiffies, then give up the assignment and let it be taken by
+	 * the cpu which runs the tick timer next. If we don't drop
+	 * this here the jiffies might be stale and do_timer() never
+	 * invoked.
+	 */
+	if (unlikely(!cpu_online(cpu))) {
+		if (cpu == tick_do_timer_cpu)
+			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
+	}
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		goto end;
+
+	if (need_resched())
+		goto end;
+
+	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
+		static int ratelimit;
+
+		if (ratelimit < 10) {
+			printk(KERN_ERR "NOHZ: local_softirq_pending %02x\n",
+			       (unsigned int) local_softirq_pending());
+			ratelimit++;
+		}
+		goto end;
+	}
+
+#ifdef CONFIG_NO_HZ_FULL
+	/*
+	 * Full dynticks cpus rely on the timekeeping cpu for jiffies,
+	 * so it keeps its tick.
+	 */
+	if (tick_nohz_full_running &&
+	    (cpu == tick_do_timer_cpu ||
+	     tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+		goto end;
+#endif
+
+	ts->idle_calls++;
+
+	expires = tick_nohz_stop_tick(ts, now, cpu);
+
+	/*
+	 * The tick may have been stopped already while a single task
+	 * ran on a full dynticks cpu, the idle side of things is only
+	 * set up here.
+	 */
+	if (ts->tick_stopped && !ts->idle_stopped) {
+		select_nohz_load_balancer(1);
+		ts->idle_jiffies = ts->last_jiffies;
+		ts->idle_stopped = 1;
+		rcu_enter_nohz();
+	}
+
+	if (expires.tv64) {
+		ts->idle_sleeps++;
+
+		/* Mark expires */
+		ts->idle_expires = expires;
+	}
 end:
 	local_irq_restore(flags);
 }
@@ -505,13 +558,13 @@ void tick_nohz_restart_sched_tick(void)
 	ktime_t now;
 
 	local_irq_disable();
-	if (ts->idle_active || (ts->inidle && ts->tick_stopped))
+	if (ts->idle_active || (ts->inidle && ts->idle_stopped))
 		now = ktime_get();
 
 	if (ts->idle_active)
 		tick_nohz_stop_idle(cpu, now);
 
-	if (!ts->inidle || !ts->tick_stopped) {
+	if (!ts->inidle || !ts->idle_stopped) {
 		ts->inidle = 0;
 		local_irq_enable();
 		return;
@@ -545,6 +598,7 @@ void tick_nohz_restart_sched_tick(void)
 	 * Cancel the scheduled timer and restore the tick
 	 */
 	ts->tick_stopped  = 0;
+	ts->idle_stopped  = 0;
 	ts->idle_exittime = now;
 
 	tick_nohz_restart(ts, now);
@@ -552,6 +606,179 @@ void tick_nohz_restart_sched_tick(void)
 	local_irq_enable();
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Full dynticks: the tick is also stopped while a single task runs on
+ * one of the cpus of tick_nohz_full_mask. It is reevaluated whenever an
+ * interrupt returns, and whoever needs the tick back on such a cpu
+ * kicks it with an interrupt. RCU and cputime accounting follow the
+ * task through context tracking while it is in userspace.
+ */
+cpumask_var_t tick_nohz_full_mask;
+bool tick_nohz_full_running;
+
+static bool can_stop_full_tick(void)
+{
+	if (!sched_can_stop_tick())
+		return false;
+
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return false;
+
+	if (!perf_event_can_stop_tick())
+		return false;
+
+	return true;
+}
+
+static void tick_nohz_full_restart(struct tick_sched *ts)
+{
+	ts->tick_stopped = 0;
+	cpumask_clear_cpu(smp_processor_id(), nohz_cpu_mask);
+	tick_nohz_restart(ts, ktime_get());
+}
+
+/**
+ * tick_nohz_irq_exit - reevaluate the tick of a full dynticks cpu
+ *
+ * Called from irq_exit() when the outermost interrupt returns, with
+ * interrupts disabled. Idle is left to tick_nohz_stop_sched_tick().
+ */
+void tick_nohz_irq_exit(void)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+	int cpu = smp_processor_id();
+
+	if (!tick_nohz_full_cpu(cpu) || ts->inidle || idle_cpu(cpu))
+		return;
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE) || !cpu_online(cpu))
+		return;
+
+	if (can_stop_full_tick())
+		tick_nohz_stop_tick(ts, ktime_get(), cpu);
+	else if (ts->tick_stopped)
+		tick_nohz_full_restart(ts);
+}
+
+static void nohz_full_kick_work_func(struct irq_work *work)
+{
+	/* tick_nohz_irq_exit() does the work when this interrupt returns */
+}
+
+static DEFINE_PER_CPU(struct irq_work, nohz_full_kick_work) = {
+	.func = nohz_full_kick_work_func,
+};
+
+/**
+ * tick_nohz_full_kick_cpu - make a full dynticks cpu reevaluate its tick
+ * @cpu: the cpu to kick
+ *
+ * Sends @cpu an interrupt, on return from which it restarts its tick if
+ * it needs it again. Can be called with interrupts disabled.
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	if (!tick_nohz_full_cpu(cpu) || !cpu_online(cpu))
+		return;
+
+	if (cpu == smp_processor_id())
+		irq_work_queue(&__get_cpu_var(nohz_full_kick_work));
+	else
+		smp_send_reschedule(cpu);
+}
+
+/**
+ * tick_nohz_full_kick_all - kick all the full dynticks cpus
+ *
+ * For events that may concern any of them, like a POSIX CPU timer
+ * being armed.
+ */
+void tick_nohz_full_kick_all(void)
+{
+	int cpu;
+
+	if (!tick_nohz_full_running)
+		return;
+
+	preempt_disable();
+	for_each_cpu_and(cpu, tick_nohz_full_mask, cpu_online_mask)
+		tick_nohz_full_kick_cpu(cpu);
+	preempt_enable();
+}
+
+/*
+ * Parse the nohz_full= boot parameter. The boot cpu keeps the
+ * timekeeping duty and is never a full dynticks cpu.
+ */
+static int __init tick_nohz_full_setup(char *str)
+{
+	int cpu;
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		cpumask_clear(tick_nohz_full_mask);
+		return 1;
+	}
+	cpumask_and(tick_nohz_full_mask, tick_nohz_full_mask,
+		    cpu_possible_mask);
+
+	cpu = smp_processor_id();
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING "NOHZ: Clearing %d from nohz_full range "
+		       "for timekeeping\n", cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+
+	if (cpumask_empty(tick_nohz_full_mask))
+		return 1;
+
+	for_each_cpu(cpu, tick_nohz_full_mask)
+		context_tracking_cpu_set(cpu);
+	tick_nohz_full_running = true;
+
+	return 1;
+}
+
+__setup("nohz_full=", tick_nohz_full_setup);
+
+static int __cpuinit tick_nohz_cpu_down_callback(struct notifier_block *nfb,
+						 unsigned long action,
+						 void *hcpu)
+{
+	int cpu = (long)hcpu;
+
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_DOWN_PREPARE:
+		/*
+		 * The full dynticks cpus rely on the timekeeping cpu for
+		 * jiffies, it can't go away.
+		 */
+		if (cpu == tick_do_timer_cpu)
+			return NOTIFY_BAD;
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static int __init tick_nohz_full_init(void)
+{
+	char buf[128];
+
+	if (!tick_nohz_full_running)
+		return 0;
+
+	hotcpu_notifier(tick_nohz_cpu_down_callback, 0);
+
+	cpulist_scnprintf(buf, sizeof(buf), tick_nohz_full_mask);
+	printk(KERN_INFO "NOHZ: Full dynticks CPUs: %s.\n", buf);
+
+	return 0;
+}
+core_initcall(tick_nohz_full_init);
+#endif /* CONFIG_NO_HZ_FULL */
+
 static int tick_nohz_reprogram(struct tick_sched *ts, ktime_t now)
 {
 	hrtimer_forward(&ts->sched_timer, now, tick_period);
@@ -592,7 +819,7 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * of idle" jiffy stamp so the idle accounting adjustment we
 	 * do when we go busy again does not account too much ticks.
 	 */
-	if (ts->tick_stopped) {
+	if (ts->idle_stopped) {
 		touch_softlockup_watchdog();
 		ts->idle_jiffies++;
 	}
@@ -752,7 +979,7 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 		 * idle" jiffy stamp so the idle accounting adjustment we do
 		 * when we go busy again does not account too much ticks.
 		 */
-		if (ts->tick_stopped) {
+		if (ts->idle_stopped) {
 			touch_softlockup_watchdog();
 			ts->idle_jiffies++;
 		}
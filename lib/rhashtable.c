@@ -0,0 +1,678 @@
+/*
+ * Resizable, Scalable, Concurrent Hash Table
+ *
+ * Writers take the spinlock of the bucket they modify, lookups only take
+ * rcu_read_lock(). While a resize is in progress the current table points
+ * at the new one through "future_tbl", and "rehash" counts the buckets
+ * that have already been moved over:
+ *
+ *  - a lookup that misses in a table retries in its future table, so an
+ *    entry which was just moved is still found;
+ *  - an insertion goes to the oldest table whose bucket for the key has
+ *    not been moved yet and, with that bucket locked, links the new entry
+ *    into the future table if there is one;
+ *  - a removal looks for the entry in each table in turn.
+ *
+ * Only the deferred worker creates future tables and it does so with
+ * ht->mutex held, so there is never more than one resize in flight.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/log2.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/rhashtable.h>
+#include <linux/module.h>
+
+#define HASH_DEFAULT_SIZE	64UL
+#define HASH_MIN_SIZE		4U
+#define BUCKET_LOCKS_PER_CPU	128UL
+
+#define ASSERT_RHT_MUTEX(HT) BUG_ON(!lockdep_rht_mutex_is_held(HT))
+
+static void *rht_obj(const struct rhashtable *ht, const struct rhash_head *he)
+{
+	return (char *)he - ht->p.head_offset;
+}
+
+static u32 key_hashfn(const struct rhashtable *ht,
+		      const struct bucket_table *tbl, const void *key)
+{
+	return ht->p.hashfn(key, ht->p.key_len, tbl->hash_rnd) &
+	       (tbl->size - 1);
+}
+
+static u32 head_hashfn(const struct rhashtable *ht,
+		       const struct bucket_table *tbl,
+		       const struct rhash_head *he)
+{
+	return key_hashfn(ht, tbl, (char *)rht_obj(ht, he) + ht->p.key_offset);
+}
+
+static spinlock_t *bucket_lock(const struct bucket_table *tbl, u32 hash)
+{
+	return &tbl->locks[hash & tbl->locks_mask];
+}
+
+#ifdef CONFIG_PROVE_LOCKING
+int lockdep_rht_mutex_is_held(struct rhashtable *ht)
+{
+	return (debug_locks) ? lockdep_is_held(&ht->mutex) : 1;
+}
+EXPORT_SYMBOL_GPL(lockdep_rht_mutex_is_held);
+
+int lockdep_rht_bucket_is_held(const struct bucket_table *tbl, u32 hash)
+{
+	spinlock_t *lock = bucket_lock(tbl, hash);
+
+	return (debug_locks) ? lockdep_is_held(lock) : 1;
+}
+EXPORT_SYMBOL_GPL(lockdep_rht_bucket_is_held);
+#endif
+
+/*
+ * Bucket arrays of big tables don't fit in a few pages, fall back to
+ * vmalloc() for them rather than failing the resize.
+ */
+static void *rht_zalloc(size_t size)
+{
+	void *ptr = NULL;
+
+	if (size <= (PAGE_SIZE << PAGE_ALLOC_COSTLY_ORDER))
+		ptr = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (!ptr)
+		ptr = vzalloc(size);
+	return ptr;
+}
+
+static void rht_free(void *ptr)
+{
+	if (is_vmalloc_addr(ptr))
+		vfree(ptr);
+	else
+		kfree(ptr);
+}
+
+static void bucket_table_free(struct bucket_table *tbl)
+{
+	if (tbl)
+		rht_free(tbl->locks);
+	rht_free(tbl);
+}
+
+static struct bucket_table *bucket_table_alloc(struct rhashtable *ht,
+					       unsigned int nbuckets)
+{
+	struct bucket_table *tbl;
+	unsigned int i, nr_locks;
+
+	tbl = rht_zalloc(sizeof(*tbl) + nbuckets * sizeof(tbl->buckets[0]));
+	if (!tbl)
+		return NULL;
+
+	tbl->size = nbuckets;
+
+	/*
+	 * More locks than buckets would be pointless, a few locks per cpu
+	 * are enough to make writer contention rare.
+	 */
+	nr_locks = roundup_pow_of_two(num_possible_cpus() * ht->p.locks_mul);
+	nr_locks = clamp_t(unsigned int, nr_locks, 1, nbuckets >> 1);
+
+	tbl->locks = rht_zalloc(nr_locks * sizeof(spinlock_t));
+	if (!tbl->locks) {
+		rht_free(tbl);
+		return NULL;
+	}
+	for (i = 0; i < nr_locks; i++)
+		spin_lock_init(&tbl->locks[i]);
+	tbl->locks_mask = nr_locks - 1;
+
+	get_random_bytes(&tbl->hash_rnd, sizeof(tbl->hash_rnd));
+
+	return tbl;
+}
+
+/* Expand when the table is more than 75% full */
+static bool rht_grow_above_75(const struct rhashtable *ht,
+			      const struct bucket_table *tbl)
+{
+	return atomic_read(&ht->nelems) > (tbl->size / 4 * 3) &&
+	       (!ht->p.max_size || tbl->size < ht->p.max_size);
+}
+
+/* Shrink when the table is less than 30% full */
+static bool rht_shrink_below_30(const struct rhashtable *ht,
+				const struct bucket_table *tbl)
+{
+	return atomic_read(&ht->nelems) < (tbl->size * 3 / 10) &&
+	       tbl->size > ht->p.min_size;
+}
+
+/*
+ * Move the last entry of a bucket to the head of its bucket in the future
+ * table. Moving the tail means the chain in the old table stays intact
+ * for concurrent readers: they can only ever see it get shorter.
+ */
+static int rhashtable_rehash_one(struct rhashtable *ht,
+				 struct bucket_table *old_tbl,
+				 unsigned int old_hash)
+{
+	struct bucket_table *new_tbl = rht_dereference(old_tbl->future_tbl, ht);
+	struct rhash_head __rcu **pprev = &old_tbl->buckets[old_hash];
+	struct rhash_head *entry, *next, *head;
+	spinlock_t *new_bucket_lock;
+	unsigned int new_hash;
+
+	entry = rht_dereference_bucket(*pprev, old_tbl, old_hash);
+	if (!entry)
+		return -ENOENT;
+
+	while ((next = rht_dereference_bucket(entry->next, old_tbl, old_hash))) {
+		pprev = &entry->next;
+		entry = next;
+	}
+
+	new_hash = head_hashfn(ht, new_tbl, entry);
+	new_bucket_lock = bucket_lock(new_tbl, new_hash);
+
+	spin_lock_nested(new_bucket_lock, SINGLE_DEPTH_NESTING);
+	head = rht_dereference_bucket(new_tbl->buckets[new_hash],
+				      new_tbl, new_hash);
+	RCU_INIT_POINTER(entry->next, head);
+	rcu_assign_pointer(new_tbl->buckets[new_hash], entry);
+	spin_unlock(new_bucket_lock);
+
+	/*
+	 * A reader that no longer finds the entry in the old chain must
+	 * find it in the new one.
+	 */
+	smp_wmb();
+	RCU_INIT_POINTER(*pprev, NULL);
+
+	return 0;
+}
+
+static void rhashtable_rehash_chain(struct rhashtable *ht,
+				    struct bucket_table *old_tbl,
+				    unsigned int old_hash)
+{
+	spinlock_t *old_bucket_lock = bucket_lock(old_tbl, old_hash);
+
+	spin_lock_bh(old_bucket_lock);
+	while (!rhashtable_rehash_one(ht, old_tbl, old_hash))
+		;
+	old_tbl->rehash++;
+	spin_unlock_bh(old_bucket_lock);
+}
+
+static int rhashtable_resize(struct rhashtable *ht, unsigned int size)
+{
+	struct bucket_table *old_tbl = rht_dereference(ht->tbl, ht);
+	struct bucket_table *new_tbl;
+	unsigned int i;
+
+	ASSERT_RHT_MUTEX(ht);
+
+	new_tbl = bucket_table_alloc(ht, size);
+	if (!new_tbl)
+		return -ENOMEM;
+
+	/*
+	 * From now on insertions into buckets that haven't been moved yet
+	 * go to the new table. Writers find it with the bucket lock held,
+	 * which orders them against the moving of that bucket below.
+	 */
+	rcu_assign_pointer(old_tbl->future_tbl, new_tbl);
+
+	for (i = 0; i < old_tbl->size; i++)
+		rhashtable_rehash_chain(ht, old_tbl, i);
+
+	rcu_assign_pointer(ht->tbl, new_tbl);
+
+	/*
+	 * Lookups and writers that still look at the old table, or follow
+	 * its future_tbl pointer, do so under rcu_read_lock().
+	 */
+	synchronize_rcu();
+	bucket_table_free(old_tbl);
+
+	return 0;
+}
+
+static void rht_deferred_worker(struct work_struct *work)
+{
+	struct rhashtable *ht = container_of(work, struct rhashtable, run_work);
+	struct bucket_table *tbl;
+	unsigned int size;
+
+	mutex_lock(&ht->mutex);
+	tbl = rht_dereference(ht->tbl, ht);
+
+	if (rht_grow_above_75(ht, tbl)) {
+		rhashtable_resize(ht, tbl->size * 2);
+	} else if (ht->p.automatic_shrinking && rht_shrink_below_30(ht, tbl)) {
+		size = roundup_pow_of_two(atomic_read(&ht->nelems) * 3 / 2 + 1);
+		size = max(size, ht->p.min_size);
+		if (size < tbl->size)
+			rhashtable_resize(ht, size);
+	}
+
+	mutex_unlock(&ht->mutex);
+}
+
+struct rhashtable_compare_arg {
+	struct rhashtable *ht;
+	const void *key;
+};
+
+static bool rhashtable_compare(void *ptr, void *arg)
+{
+	struct rhashtable_compare_arg *x = arg;
+	struct rhashtable *ht = x->ht;
+
+	return !memcmp((char *)ptr + ht->p.key_offset, x->key, ht->p.key_len);
+}
+
+static bool rht_bucket_find(struct rhashtable *ht, struct bucket_table *tbl,
+			    unsigned int hash,
+			    bool (*compare)(void *, void *), void *arg)
+{
+	struct rhash_head *he;
+
+	rht_for_each(he, tbl, hash) {
+		if (compare(rht_obj(ht, he), arg))
+			return true;
+	}
+	return false;
+}
+
+static bool __rhashtable_insert(struct rhashtable *ht, struct rhash_head *obj,
+				bool (*compare)(void *, void *), void *arg)
+{
+	struct bucket_table *tbl, *new_tbl;
+	struct rhash_head *head;
+	spinlock_t *old_lock, *new_lock = NULL;
+	unsigned int hash, new_hash = 0;
+	bool inserted = false;
+
+	rcu_read_lock();
+
+	/*
+	 * All insertions must take the lock of the oldest table whose bucket
+	 * for this key has not been moved to the future table yet.
+	 */
+	tbl = rht_dereference_rcu(ht->tbl, ht);
+	for (;;) {
+		hash = head_hashfn(ht, tbl, obj);
+		old_lock = bucket_lock(tbl, hash);
+		spin_lock_bh(old_lock);
+
+		if (tbl->rehash <= hash)
+			break;
+
+		spin_unlock_bh(old_lock);
+		tbl = rht_dereference_rcu(tbl->future_tbl, ht);
+	}
+
+	new_tbl = rht_dereference_rcu(tbl->future_tbl, ht);
+	if (new_tbl) {
+		new_hash = head_hashfn(ht, new_tbl, obj);
+		new_lock = bucket_lock(new_tbl, new_hash);
+		spin_lock_nested(new_lock, SINGLE_DEPTH_NESTING);
+	}
+
+	if (compare &&
+	    (rht_bucket_find(ht, tbl, hash, compare, arg) ||
+	     (new_tbl && rht_bucket_find(ht, new_tbl, new_hash, compare, arg))))
+		goto exit;
+
+	if (new_tbl) {
+		tbl = new_tbl;
+		hash = new_hash;
+	}
+
+	head = rht_dereference_bucket(tbl->buckets[hash], tbl, hash);
+	RCU_INIT_POINTER(obj->next, head);
+	rcu_assign_pointer(tbl->buckets[hash], obj);
+	inserted = true;
+
+	atomic_inc(&ht->nelems);
+	if (rht_grow_above_75(ht, tbl))
+		schedule_work(&ht->run_work);
+
+exit:
+	if (new_lock)
+		spin_unlock(new_lock);
+	spin_unlock_bh(old_lock);
+
+	rcu_read_unlock();
+
+	return inserted;
+}
+
+/**
+ * rhashtable_insert - insert object into hash table
+ * @ht:		hash table
+ * @obj:	pointer to hash head inside object
+ *
+ * Will take a per bucket spinlock to protect against mutual mutations
+ * on the same bucket. Multiple insertions may occur in parallel unless
+ * they map to the same bucket lock.
+ *
+ * It is safe to call this function from softirq context.
+ *
+ * Will trigger an automatic deferred table resizing if the load factor
+ * grows above 75%.
+ */
+void rhashtable_insert(struct rhashtable *ht, struct rhash_head *obj)
+{
+	__rhashtable_insert(ht, obj, NULL, NULL);
+}
+EXPORT_SYMBOL_GPL(rhashtable_insert);
+
+static bool __rhashtable_remove(struct rhashtable *ht,
+				struct bucket_table *tbl,
+				struct rhash_head *obj)
+{
+	struct rhash_head __rcu **pprev;
+	struct rhash_head *he;
+	spinlock_t *lock;
+	unsigned int hash;
+	bool found = false;
+
+	hash = head_hashfn(ht, tbl, obj);
+	lock = bucket_lock(tbl, hash);
+
+	spin_lock_bh(lock);
+
+	pprev = &tbl->buckets[hash];
+	rht_for_each(he, tbl, hash) {
+		if (he != obj) {
+			pprev = &he->next;
+			continue;
+		}
+
+		rcu_assign_pointer(*pprev, obj->next);
+		found = true;
+		break;
+	}
+
+	spin_unlock_bh(lock);
+
+	return found;
+}
+
+/**
+ * rhashtable_remove - remove object from hash table
+ * @ht:		hash table
+ * @obj:	pointer to hash head inside object
+ *
+ * Since the hash chain is single linked, the removal operation needs to
+ * walk the bucket chain upon removal. The removal operation is thus
+ * considerably slow if the hash table is not correctly sized.
+ *
+ * The object may still be seen by lookups that started before the
+ * removal, it must not be freed before an RCU grace period has elapsed.
+ *
+ * Will automatically shrink the table if automatic_shrinking is set and
+ * the load factor drops below 30%.
+ *
+ * Returns true if the object was found and removed.
+ */
+bool rhashtable_remove(struct rhashtable *ht, struct rhash_head *obj)
+{
+	struct bucket_table *tbl;
+	bool found = false;
+
+	rcu_read_lock();
+
+	/*
+	 * The entry may have been moved to the future table. Taking the
+	 * bucket lock in __rhashtable_remove() makes the future table of a
+	 * bucket that was moved visible.
+	 */
+	tbl = rht_dereference_rcu(ht->tbl, ht);
+	while (tbl && !(found = __rhashtable_remove(ht, tbl, obj)))
+		tbl = rht_dereference_rcu(tbl->future_tbl, ht);
+
+	if (found) {
+		atomic_dec(&ht->nelems);
+		if (ht->p.automatic_shrinking && rht_shrink_below_30(ht, tbl))
+			schedule_work(&ht->run_work);
+	}
+
+	rcu_read_unlock();
+
+	return found;
+}
+EXPORT_SYMBOL_GPL(rhashtable_remove);
+
+/**
+ * rhashtable_lookup_compare - search hash table with compare function
+ * @ht:		hash table
+ * @key:	the pointer to the key
+ * @compare:	compare function, must return true on match
+ * @arg:	argument passed on to compare function
+ *
+ * Computes the hash value for the key and traverses the bucket chain
+ * looking for an entry for which @compare returns true.  The table may
+ * be resized concurrently, the lookup then also searches the new table.
+ *
+ * The caller must hold rcu_read_lock() for as long as it uses the
+ * returned object.
+ *
+ * Returns the first entry on which the compare function returned true.
+ */
+void *rhashtable_lookup_compare(struct rhashtable *ht, const void *key,
+				bool (*compare)(void *, void *), void *arg)
+{
+	const struct bucket_table *tbl;
+	struct rhash_head *he;
+	u32 hash;
+
+	rcu_read_lock();
+
+	tbl = rht_dereference_rcu(ht->tbl, ht);
+restart:
+	hash = key_hashfn(ht, tbl, key);
+	rht_for_each_rcu(he, tbl, hash) {
+		if (!compare(rht_obj(ht, he), arg))
+			continue;
+		rcu_read_unlock();
+		return rht_obj(ht, he);
+	}
+
+	/* Ensure we see any new tables. */
+	smp_rmb();
+
+	tbl = rht_dereference_rcu(tbl->future_tbl, ht);
+	if (unlikely(tbl))
+		goto restart;
+
+	rcu_read_unlock();
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(rhashtable_lookup_compare);
+
+/**
+ * rhashtable_lookup - lookup key in hash table
+ * @ht:		hash table
+ * @key:	pointer to key
+ *
+ * Computes the hash value for the key and traverses the bucket chain
+ * looking for an entry with an identical key.  The first matching entry
+ * is returned.
+ *
+ * The caller must hold rcu_read_lock() for as long as it uses the
+ * returned object.
+ */
+void *rhashtable_lookup(struct rhashtable *ht, const void *key)
+{
+	struct rhashtable_compare_arg arg = {
+		.ht = ht,
+		.key = key,
+	};
+
+	return rhashtable_lookup_compare(ht, key, rhashtable_compare, &arg);
+}
+EXPORT_SYMBOL_GPL(rhashtable_lookup);
+
+/**
+ * rhashtable_lookup_compare_insert - search and insert object to hash table
+ *                                    with compare function
+ * @ht:		hash table
+ * @obj:	pointer to hash head inside object
+ * @compare:	compare function, must return true on match
+ * @arg:	argument passed on to compare function
+ *
+ * Locks down the bucket chain in both the old and new table if a resize
+ * is in progress to ensure that writers can't remove from the old table
+ * and can't insert to the new table during the atomic operation of search
+ * and insertion.  Searches for duplicates in both the old and new table if
+ * a resize is in progress.
+ *
+ * Returns false if an entry for which @compare returns true is already
+ * in the table, true if @obj was inserted.
+ */
+bool rhashtable_lookup_compare_insert(struct rhashtable *ht,
+				      struct rhash_head *obj,
+				      bool (*compare)(void *, void *),
+				      void *arg)
+{
+	return __rhashtable_insert(ht, obj, compare, arg);
+}
+EXPORT_SYMBOL_GPL(rhashtable_lookup_compare_insert);
+
+/**
+ * rhashtable_lookup_insert - lookup and insert object into hash table
+ * @ht:		hash table
+ * @obj:	pointer to hash head inside object
+ *
+ * Same as rhashtable_lookup_compare_insert(), with the keys compared
+ * byte by byte.
+ *
+ * Returns false if an entry with the same key is already in the table,
+ * true if @obj was inserted.
+ */
+bool rhashtable_lookup_insert(struct rhashtable *ht, struct rhash_head *obj)
+{
+	struct rhashtable_compare_arg arg = {
+		.ht = ht,
+		.key = (char *)rht_obj(ht, obj) + ht->p.key_offset,
+	};
+
+	return __rhashtable_insert(ht, obj, rhashtable_compare, &arg);
+}
+EXPORT_SYMBOL_GPL(rhashtable_lookup_insert);
+
+static unsigned int rounded_hashtable_size(const struct rhashtable_params *p)
+{
+	return max_t(unsigned int, roundup_pow_of_two(p->nelem_hint * 4 / 3),
+		     p->min_size);
+}
+
+/**
+ * rhashtable_init - initialize a new hash table
+ * @ht:		hash table to be initialized
+ * @params:	configuration parameters
+ *
+ * Initializes a new hash table based on the provided configuration
+ * parameters. A table can be configured either with a fixed length
+ * key or a custom hash function:
+ *
+ * Configuration Example 1: Fixed length keys
+ * struct test_obj {
+ *	int			key;
+ *	void *			my_member;
+ *	struct rhash_head	node;
+ * };
+ *
+ * struct rhashtable_params params = {
+ *	.head_offset = offsetof(struct test_obj, node),
+ *	.key_offset = offsetof(struct test_obj, key),
+ *	.key_len = sizeof(int),
+ * };
+ *
+ * Configuration Example 2: Custom hash function for the same keys
+ * struct rhashtable_params params = {
+ *	.head_offset = offsetof(struct test_obj, node),
+ *	.key_offset = offsetof(struct test_obj, key),
+ *	.key_len = sizeof(int),
+ *	.hashfn = my_hash_fn,
+ * };
+ */
+int rhashtable_init(struct rhashtable *ht,
+		    const struct rhashtable_params *params)
+{
+	struct bucket_table *tbl;
+	unsigned int size;
+
+	if (!params->key_len)
+		return -EINVAL;
+
+	memset(ht, 0, sizeof(*ht));
+	mutex_init(&ht->mutex);
+	memcpy(&ht->p, params, sizeof(*params));
+
+	if (params->min_size)
+		ht->p.min_size = roundup_pow_of_two(params->min_size);
+	ht->p.min_size = max(ht->p.min_size, HASH_MIN_SIZE);
+
+	if (params->max_size)
+		ht->p.max_size = max_t(unsigned int,
+				       rounddown_pow_of_two(params->max_size),
+				       ht->p.min_size);
+
+	if (!params->locks_mul)
+		ht->p.locks_mul = BUCKET_LOCKS_PER_CPU;
+
+	if (!params->hashfn)
+		ht->p.hashfn = jhash;
+
+	size = HASH_DEFAULT_SIZE;
+	if (params->nelem_hint)
+		size = rounded_hashtable_size(&ht->p);
+	if (ht->p.max_size)
+		size = min(size, ht->p.max_size);
+
+	tbl = bucket_table_alloc(ht, size);
+	if (!tbl)
+		return -ENOMEM;
+
+	atomic_set(&ht->nelems, 0);
+	RCU_INIT_POINTER(ht->tbl, tbl);
+	INIT_WORK(&ht->run_work, rht_deferred_worker);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(rhashtable_init);
+
+/**
+ * rhashtable_destroy - destroy hash table
+ * @ht:		the hash table to destroy
+ *
+ * Frees the bucket array and waits for a pending resize to finish. This
+ * function is not rcu safe, therefore the caller has to make sure that
+ * no resizing can happen concurrently and that the table is empty or its
+ * entries are freed by other means.
+ */
+void rhashtable_destroy(struct rhashtable *ht)
+{
+	cancel_work_sync(&ht->run_work);
+
+	mutex_lock(&ht->mutex);
+	bucket_table_free(rht_dereference(ht->tbl, ht));
+	mutex_unlock(&ht->mutex);
+}
+EXPORT_SYMBOL_GPL(rhashtable_destroy);
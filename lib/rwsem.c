@@ -7,6 +7,7 @@
 #include <linux/sched.h>
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 
 /*
  * Initialize an rwsem:
@@ -24,6 +25,10 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->count = RWSEM_UNLOCKED_VALUE;
 	spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+	sem->spin_queue = NULL;
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
@@ -37,12 +42,16 @@ struct rwsem_waiter {
 };
 
 /* Wake types for __rwsem_do_wake().  Note that RWSEM_WAKE_NO_ACTIVE and
- * RWSEM_WAKE_READ_OWNED imply that the spinlock must have been kept held
- * since the rwsem value was observed.
+ * RWSEM_WAKE_READERS imply that the spinlock must have been kept held
+ * since the rwsem value was observed.  Writers spinning in
+ * rwsem_down_write_failed() take the rwsem without the spinlock though,
+ * so only RWSEM_WAKE_READ_OWNED, where the caller itself holds a read
+ * lock, guarantees that it cannot be write locked under us.
  */
 #define RWSEM_WAKE_ANY        0 /* Wake whatever's at head of wait list */
 #define RWSEM_WAKE_NO_ACTIVE  1 /* rwsem was observed with no active thread */
-#define RWSEM_WAKE_READ_OWNED 2 /* rwsem was observed to be read owned */
+#define RWSEM_WAKE_READERS    2 /* rwsem was observed to be read owned */
+#define RWSEM_WAKE_READ_OWNED 3 /* we hold a read lock on the rwsem */
 
 /*
  * handle the lock release when processes blocked on it that can now run
@@ -66,7 +75,8 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 	if (!(waiter->flags & RWSEM_WAITING_FOR_WRITE))
 		goto readers_only;
 
-	if (wake_type == RWSEM_WAKE_READ_OWNED)
+	if (wake_type == RWSEM_WAKE_READERS ||
+	    wake_type == RWSEM_WAKE_READ_OWNED)
 		/* Another active reader was observed, so wakeup is not
 		 * likely to succeed. Save the atomic op.
 		 */
@@ -105,18 +115,27 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 	 * this first in order to not spend too much time with the spinlock
 	 * held if we're not going to be able to wake up readers in the end.
 	 *
-	 * Note that we do not need to update the rwsem count: any writer
-	 * trying to acquire rwsem will run rwsem_down_write_failed() due
-	 * to the waiting threads and block trying to acquire the spinlock.
-	 *
-	 * We use a dummy atomic update in order to acquire the cache line
-	 * exclusively since we expect to succeed and run the final rwsem
-	 * count adjustment pretty soon.
+	 * A writer spinning in rwsem_down_write_failed() can grab the rwsem
+	 * without taking the spinlock, so unless we hold a read lock
+	 * ourselves, grant one read lock first and back off if a writer
+	 * turns out to have won.
 	 */
-	if (wake_type == RWSEM_WAKE_ANY &&
-	    rwsem_atomic_update(0, sem) < RWSEM_WAITING_BIAS)
-		/* Someone grabbed the sem for write already */
-		goto out;
+	adjustment = 0;
+	if (wake_type != RWSEM_WAKE_READ_OWNED) {
+		adjustment = RWSEM_ACTIVE_READ_BIAS;
+ try_reader_grant:
+		oldcount = rwsem_atomic_update(adjustment, sem) - adjustment;
+		if (unlikely(oldcount < RWSEM_WAITING_BIAS)) {
+			/* Someone grabbed the sem for write already; undo
+			 * our grant, unless we were the last active locker
+			 * left, in which case try again.
+			 */
+			if (rwsem_atomic_update(-adjustment, sem) &
+						RWSEM_ACTIVE_MASK)
+				goto out;
+			goto try_reader_grant;
+		}
+	}
 
 	/* Grant an infinite number of read locks to the readers at the front
 	 * of the queue.  Note we increment the 'active part' of the count by
@@ -134,12 +153,13 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 
 	} while (waiter->flags & RWSEM_WAITING_FOR_READ);
 
-	adjustment = woken * RWSEM_ACTIVE_READ_BIAS;
+	adjustment = woken * RWSEM_ACTIVE_READ_BIAS - adjustment;
 	if (waiter->flags & RWSEM_WAITING_FOR_READ)
 		/* hit end of list above */
 		adjustment -= RWSEM_WAITING_BIAS;
 
-	rwsem_atomic_add(adjustment, sem);
+	if (adjustment)
+		rwsem_atomic_add(adjustment, sem);
 
 	next = sem->wait_list.next;
 	for (loop = woken; loop > 0; loop--) {
@@ -201,8 +221,8 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 	if (count == RWSEM_WAITING_BIAS)
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_NO_ACTIVE);
 	else if (count > RWSEM_WAITING_BIAS &&
-		 adjustment == -RWSEM_ACTIVE_WRITE_BIAS)
-		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED);
+		 (flags & RWSEM_WAITING_FOR_WRITE))
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READERS);
 
 	spin_unlock_irq(&sem->wait_lock);
 
@@ -228,13 +248,151 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 					-RWSEM_ACTIVE_READ_BIAS);
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Writers that want to spin queue up MCS style, each spinning on its own
+ * node, so that only the one at the head of the queue polls the rwsem
+ * and the owner instead of all of them bouncing its cacheline.
+ */
+struct rwsem_spin_node {
+	struct rwsem_spin_node *next;
+	int locked;
+};
+
+static void rwsem_spin_queue_lock(struct rw_semaphore *sem,
+				  struct rwsem_spin_node *node)
+{
+	struct rwsem_spin_node *prev;
+
+	node->next = NULL;
+	node->locked = 0;
+	prev = xchg(&sem->spin_queue, node);
+	if (likely(prev == NULL))
+		return;
+	ACCESS_ONCE(prev->next) = node;
+	/* wait until the previous spinner hands over to us */
+	while (!ACCESS_ONCE(node->locked))
+		arch_mutex_cpu_relax();
+	smp_rmb();
+}
+
+static void rwsem_spin_queue_unlock(struct rw_semaphore *sem,
+				    struct rwsem_spin_node *node)
+{
+	struct rwsem_spin_node *next = ACCESS_ONCE(node->next);
+
+	if (likely(!next)) {
+		/* nobody queued behind us */
+		if (cmpxchg(&sem->spin_queue, node, NULL) == node)
+			return;
+		/* somebody is queueing, wait for it to link itself in */
+		while (!(next = ACCESS_ONCE(node->next)))
+			arch_mutex_cpu_relax();
+	}
+	smp_wmb();
+	ACCESS_ONCE(next->locked) = 1;
+}
+
+/*
+ * Take the write lock if it is free, whether or not there are waiters
+ * queued on it.  We hold no active bias while spinning.
+ */
+static inline int rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = ACCESS_ONCE(sem->count);
+
+	while (count == 0 || count == RWSEM_WAITING_BIAS) {
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count)
+			return 1;
+		count = old;
+	}
+	return 0;
+}
+
+static inline int rwsem_can_spin_on_owner(struct rw_semaphore *sem)
+{
+	/*
+	 * If we own the BKL, then don't spin. The owner of the rwsem
+	 * might be waiting on us to release the BKL.
+	 */
+	if (unlikely(current->lock_depth >= 0))
+		return 0;
+
+	/* Readers can hold the rwsem for long, don't spin behind them */
+	return ACCESS_ONCE(sem->owner) != RWSEM_READER_OWNED;
+}
+
+/*
+ * Optimistic spinning: as long as the writer holding the rwsem is running,
+ * it is likely to release it soon, and spinning is cheaper than going to
+ * sleep and being woken up again.  This mirrors the mutex spinning in
+ * __mutex_lock_common().
+ */
+static int rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	struct rwsem_spin_node node;
+	struct thread_info *owner;
+	int taken = 0;
+
+	preempt_disable();
+	rwsem_spin_queue_lock(sem, &node);
+
+	for (;;) {
+		if (rwsem_try_write_lock_unqueued(sem)) {
+			taken = 1;
+			break;
+		}
+
+		owner = ACCESS_ONCE(sem->owner);
+		if (owner == RWSEM_READER_OWNED)
+			break;
+
+		/*
+		 * If there's an owner, wait for it to either
+		 * release the lock or go to sleep.
+		 */
+		if (owner && !rwsem_spin_on_owner(sem, owner))
+			break;
+
+		/*
+		 * When there's no owner, we might have preempted between the
+		 * owner acquiring the lock and setting the owner field. If
+		 * we're an RT task that will live-lock because we won't let
+		 * the owner complete.
+		 */
+		if (!owner && (need_resched() || rt_task(current)))
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+
+	rwsem_spin_queue_unlock(sem, &node);
+	preempt_enable();
+
+	return taken;
+}
+#endif
+
 /*
  * wait for the write lock to be granted
  */
 struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 {
+	signed long adjustment = -RWSEM_ACTIVE_WRITE_BIAS;
+
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	if (rwsem_can_spin_on_owner(sem)) {
+		/* Drop our active bias, nobody can take the rwsem under it */
+		rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
+		if (rwsem_optimistic_spin(sem))
+			return sem;
+		adjustment = 0;
+	}
+#endif
 	return rwsem_down_failed_common(sem, RWSEM_WAITING_FOR_WRITE,
-					-RWSEM_ACTIVE_WRITE_BIAS);
+					adjustment);
 }
 
 /*
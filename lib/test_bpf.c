@@ -0,0 +1,630 @@
+/*
+ * Testsuite for the socket filter interpreter and JIT compiler
+ *
+ * Every test program is run both through sk_run_filter() and through
+ * SK_RUN_FILTER(), which uses the JIT image when the filter could be
+ * compiled (net.core.bpf_jit_enable must be set before loading this
+ * module). Both results must match the expected one.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/filter.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/if_arp.h>
+#include <linux/if_ether.h>
+#include <linux/gfp.h>
+
+#define MAX_INSNS	32
+#define MAX_DATA	64
+
+/* flags */
+#define NONLINEAR	1	/* only the first 16 bytes are in skb->head */
+#define NO_DEV		2	/* run with skb->dev == NULL */
+#define EXPECT_CPU	4	/* expected result is smp_processor_id() */
+
+#define SKB_MARK	0x12345678
+#define SKB_RXHASH	0x9abcdef0
+#define SKB_QUEUE	0xbeef
+#define SKB_TYPE	PACKET_MULTICAST
+#define SKB_DEV_IFINDEX	577
+#define SKB_DEV_TYPE	ARPHRD_ETHER
+
+struct bpf_test {
+	const char *descr;
+	struct sock_filter insns[MAX_INSNS];
+	unsigned int flags;
+	unsigned int result;
+};
+
+/* 00 01 02 ... 3f */
+static unsigned char test_data[MAX_DATA] __initdata;
+
+static struct bpf_test tests[] __initdata = {
+	{
+		"RET_K",
+		{
+			BPF_STMT(BPF_RET | BPF_K, 42),
+		},
+		0, 42
+	},
+	{
+		"RET_A",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 7),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 7
+	},
+	{
+		"LD_IMM_LDX_IMM_TXA",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 1),
+			BPF_STMT(BPF_LDX | BPF_IMM, 0xfffffff0),
+			BPF_STMT(BPF_MISC | BPF_TXA, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 0xfffffff0
+	},
+	{
+		"TAX",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 3),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 6
+	},
+	{
+		"ALU_ADD",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 1),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 100),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 0x10000),
+			BPF_STMT(BPF_LDX | BPF_IMM, 0xffffffff),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 0x10064
+	},
+	{
+		"ALU_SUB",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 1000),
+			BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, 1),
+			BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, 500),
+			BPF_STMT(BPF_LDX | BPF_IMM, 1000),
+			BPF_STMT(BPF_ALU | BPF_SUB | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, (unsigned int)-501
+	},
+	{
+		"ALU_MUL",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 3),
+			BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 7),
+			BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x10001),
+			BPF_STMT(BPF_LDX | BPF_IMM, 0xffffffff),
+			BPF_STMT(BPF_ALU | BPF_MUL | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, (unsigned int)-(21 * 0x10001)
+	},
+	{
+		"ALU_DIV_K",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 0xfffffff0),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_K, 3),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_K, 2),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 0xfffffff0 / 3 / 2
+	},
+	{
+		"ALU_DIV_X",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 0xfffffff0),
+			BPF_STMT(BPF_LDX | BPF_IMM, 7),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 0xfffffff0 / 7
+	},
+	{
+		"ALU_DIV_X_ZERO",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 12),
+			BPF_STMT(BPF_LDX | BPF_IMM, 0),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		0, 0
+	},
+	{
+		"ALU_DIV_X_ZERO_RET0",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 0),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 1, 0, 1),
+			BPF_STMT(BPF_RET | BPF_K, 0),
+			BPF_STMT(BPF_LD | BPF_IMM, 12),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		0, 0
+	},
+	{
+		"ALU_AND",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 0xdeadbeef),
+			BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xffffff0f),
+			BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xffff00ff),
+			BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x0ffffff0),
+			BPF_STMT(BPF_LDX | BPF_IMM, 0xf0f0f0f0),
+			BPF_STMT(BPF_ALU | BPF_AND | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 0xdeadbeef & 0xffffff0f & 0xffff00ff & 0x0ffffff0 & 0xf0f0f0f0
+	},
+	{
+		"ALU_OR",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 0x1),
+			BPF_STMT(BPF_ALU | BPF_OR | BPF_K, 0x10),
+			BPF_STMT(BPF_ALU | BPF_OR | BPF_K, 0x1000),
+			BPF_STMT(BPF_LDX | BPF_IMM, 0x80000000),
+			BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 0x80001011
+	},
+	{
+		"ALU_LSH",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 0x3),
+			BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 1),
+			BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 4),
+			BPF_STMT(BPF_LDX | BPF_IMM, 20),
+			BPF_STMT(BPF_ALU | BPF_LSH | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 0x3 << 25
+	},
+	{
+		"ALU_RSH",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 0x80000000),
+			BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 1),
+			BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+			BPF_STMT(BPF_LDX | BPF_IMM, 20),
+			BPF_STMT(BPF_ALU | BPF_RSH | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 0x80000000 >> 25
+	},
+	{
+		"ALU_NEG",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 5),
+			BPF_STMT(BPF_ALU | BPF_NEG, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, (unsigned int)-5
+	},
+	{
+		"LD_ABS",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 4),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 33),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 63),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 0x04050607 + 0x2122 + 0x3f
+	},
+	{
+		"LD_ABS_NONLINEAR",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 14),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 15),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 40),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		NONLINEAR, 0x0e0f1011 + 0x0f10 + 0x28
+	},
+	{
+		"LD_ABS_OUT_OF_RANGE",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 61),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		0, 0
+	},
+	{
+		"LD_ABS_NET_OFF",
+		{
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF + 1),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 2),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 0x0f + 0x10111213
+	},
+	{
+		"LD_ABS_LL_OFF",
+		{
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_LL_OFF + 12),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 0x0c0d
+	},
+	{
+		"LD_ABS_BAD_NEG_OFF",
+		{
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_LL_OFF - 1),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		0, 0
+	},
+	{
+		"LD_IND",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 8),
+			BPF_STMT(BPF_LD | BPF_W | BPF_IND, 0),
+			BPF_STMT(BPF_ST, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_MEM, 0),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_B | BPF_IND, 3 - (0x08090a0b + 0x0a0b)),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 3
+	},
+	{
+		"LD_IND_OUT_OF_RANGE",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 60),
+			BPF_STMT(BPF_LD | BPF_H | BPF_IND, 3),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		0, 0
+	},
+	{
+		"LD_IND_NONLINEAR",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 20),
+			BPF_STMT(BPF_LD | BPF_W | BPF_IND, 0),
+			BPF_STMT(BPF_ST, 2),
+			BPF_STMT(BPF_LDX | BPF_IMM, 10),
+			BPF_STMT(BPF_LD | BPF_H | BPF_IND, 5),
+			BPF_STMT(BPF_ST, 1),
+			BPF_STMT(BPF_LD | BPF_B | BPF_IND, 30),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_MEM, 1),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_MEM, 2),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		NONLINEAR, 0x14151617 + 0x0f10 + 0x28
+	},
+	{
+		"LD_IND_NET_OFF",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, SKF_NET_OFF),
+			BPF_STMT(BPF_LD | BPF_B | BPF_IND, 3),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 0x11
+	},
+	{
+		"LD_LEN",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+			BPF_STMT(BPF_LDX | BPF_W | BPF_LEN, 0),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		NONLINEAR, 2 * MAX_DATA
+	},
+	{
+		"LDX_MSH",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 1000),
+			BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 40),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, SKF_NET_OFF + 1),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		NONLINEAR, 1000 + 4 * 0xe + 4 * 0x8 + 4 * 0xf
+	},
+	{
+		"LDX_MSH_OUT_OF_RANGE",
+		{
+			BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 64),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		0, 0
+	},
+	{
+		"ST_LD_MEM",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 1),
+			BPF_STMT(BPF_ST, 0),
+			BPF_STMT(BPF_LDX | BPF_IMM, 2),
+			BPF_STMT(BPF_STX, 15),
+			BPF_STMT(BPF_LD | BPF_IMM, 4),
+			BPF_STMT(BPF_ST, 7),
+			BPF_STMT(BPF_LD | BPF_MEM, 0),
+			BPF_STMT(BPF_LDX | BPF_MEM, 15),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_LDX | BPF_MEM, 7),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 7
+	},
+	{
+		"JMP_JA",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 1),
+			BPF_JUMP(BPF_JMP | BPF_JA, 1, 0, 0),
+			BPF_STMT(BPF_RET | BPF_K, 2),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, 1
+	},
+	{
+		"JMP_JEQ",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 5),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 5, 0, 5),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 4, 0),
+			BPF_STMT(BPF_LDX | BPF_IMM, 5),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_X, 0, 0, 2),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 1000, 1, 0),
+			BPF_STMT(BPF_RET | BPF_K, 10),
+			BPF_STMT(BPF_RET | BPF_K, 0),
+		},
+		0, 10
+	},
+	{
+		"JMP_JGT_JGE",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 0x80000000),
+			BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, 0x7fffffff, 0, 6),
+			BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 0x80000000, 0, 5),
+			BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, 0x80000000, 4, 0),
+			BPF_STMT(BPF_LDX | BPF_IMM, 0x80000001),
+			BPF_JUMP(BPF_JMP | BPF_JGE | BPF_X, 0, 2, 0),
+			BPF_JUMP(BPF_JMP | BPF_JGT | BPF_X, 0, 1, 0),
+			BPF_STMT(BPF_RET | BPF_K, 20),
+			BPF_STMT(BPF_RET | BPF_K, 0),
+		},
+		0, 20
+	},
+	{
+		"JMP_JSET",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 0x00010200),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0xff, 6, 0),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x200, 0, 5),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0xfd00, 4, 0),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x30000, 0, 3),
+			BPF_STMT(BPF_LDX | BPF_IMM, 0x10000),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_X, 0, 0, 1),
+			BPF_STMT(BPF_RET | BPF_K, 30),
+			BPF_STMT(BPF_RET | BPF_K, 0),
+		},
+		0, 30
+	},
+	{
+		"JMP_SAME_TARGET",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 5),
+			BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, 1, 1, 1),
+			BPF_STMT(BPF_RET | BPF_K, 0),
+			BPF_STMT(BPF_RET | BPF_K, 40),
+		},
+		0, 40
+	},
+	{
+		"ANC_PROTOCOL",
+		{
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, ETH_P_IP
+	},
+	{
+		"ANC_PKTTYPE",
+		{
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, SKB_TYPE
+	},
+	{
+		"ANC_IFINDEX_HATYPE",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_AD_OFF + SKF_AD_HATYPE),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, SKB_DEV_IFINDEX + SKB_DEV_TYPE
+	},
+	{
+		"ANC_IFINDEX_NO_DEV",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		NO_DEV, 0
+	},
+	{
+		"ANC_HATYPE_NO_DEV",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_HATYPE),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		NO_DEV, 0
+	},
+	{
+		"ANC_MARK_RXHASH_QUEUE",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_MARK),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_RXHASH),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_AD_OFF + SKF_AD_QUEUE),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0, SKB_MARK + SKB_RXHASH + SKB_QUEUE
+	},
+	{
+		"ANC_CPU",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		EXPECT_CPU, 0
+	},
+};
+
+static struct net_device test_dev __initdata;
+
+static struct sk_buff *__init populate_skb(const struct bpf_test *test)
+{
+	unsigned int headlen = (test->flags & NONLINEAR) ? 16 : MAX_DATA;
+	struct sk_buff *skb;
+	struct page *page;
+
+	skb = alloc_skb(MAX_DATA, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	memcpy(skb_put(skb, headlen), test_data, headlen);
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, ETH_HLEN);
+	skb->protocol = htons(ETH_P_IP);
+	skb->pkt_type = SKB_TYPE;
+	skb->mark = SKB_MARK;
+	skb->rxhash = SKB_RXHASH;
+	skb->queue_mapping = SKB_QUEUE;
+	skb->dev = (test->flags & NO_DEV) ? NULL : &test_dev;
+
+	if (headlen < MAX_DATA) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			kfree_skb(skb);
+			return NULL;
+		}
+		memcpy(page_address(page), test_data + headlen,
+		       MAX_DATA - headlen);
+		skb_fill_page_desc(skb, 0, page, 0, MAX_DATA - headlen);
+		skb->len += MAX_DATA - headlen;
+		skb->data_len += MAX_DATA - headlen;
+		skb->truesize += PAGE_SIZE;
+	}
+	return skb;
+}
+
+static int __init run_one(const struct bpf_test *test, int *jitted)
+{
+	struct sock_fprog fprog;
+	struct sk_filter *fp;
+	struct sk_buff *skb;
+	unsigned int interp, jit, expected;
+	int flen, err;
+
+	for (flen = MAX_INSNS; flen > 0; flen--)
+		if (test->insns[flen - 1].code || test->insns[flen - 1].k)
+			break;
+
+	fprog.len = flen;
+	fprog.filter = (struct sock_filter __force __user *)test->insns;
+	err = sk_unattached_filter_create(&fp, &fprog);
+	if (err) {
+		pr_err("%s: filter rejected (%d)\n", test->descr, err);
+		return err;
+	}
+	if (fp->bpf_func != sk_run_filter)
+		(*jitted)++;
+
+	skb = populate_skb(test);
+	if (!skb) {
+		sk_unattached_filter_destroy(fp);
+		return -ENOMEM;
+	}
+
+	preempt_disable();
+	interp = sk_run_filter(skb, fp->insns);
+	jit = SK_RUN_FILTER(fp, skb);
+	expected = (test->flags & EXPECT_CPU) ? smp_processor_id() :
+						test->result;
+	preempt_enable();
+
+	if (interp != expected || jit != expected) {
+		pr_err("%s: FAIL expected %u interpreter %u jit %u\n",
+		       test->descr, expected, interp, jit);
+		err = -EINVAL;
+	}
+
+	kfree_skb(skb);
+	sk_unattached_filter_destroy(fp);
+	return err;
+}
+
+static int __init test_bpf_init(void)
+{
+	int i, jitted = 0, failed = 0;
+
+	for (i = 0; i < MAX_DATA; i++)
+		test_data[i] = i;
+	test_dev.ifindex = SKB_DEV_IFINDEX;
+	test_dev.type = SKB_DEV_TYPE;
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++)
+		if (run_one(&tests[i], &jitted))
+			failed++;
+
+	pr_info("%zu tests, %d jitted, %d failed\n",
+		ARRAY_SIZE(tests), jitted, failed);
+
+	return failed ? -EINVAL : 0;
+}
+
+static void __exit test_bpf_exit(void)
+{
+}
+
+module_init(test_bpf_init);
+module_exit(test_bpf_exit);
+MODULE_LICENSE("GPL");
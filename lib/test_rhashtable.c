@@ -0,0 +1,191 @@
+/*
+ * Resizable, Scalable, Concurrent Hash Table test module
+ *
+ * Inserts enough entries into a deliberately small table to make it
+ * expand several times, checks that every entry can be looked up and
+ * removed, and that the table shrinks again once it is empty. Insertion
+ * and lookup times are reported in the kernel log.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/hrtimer.h>
+#include <linux/rcupdate.h>
+#include <linux/rhashtable.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+
+static unsigned int entries = 50000;
+module_param(entries, uint, 0444);
+MODULE_PARM_DESC(entries, "Number of entries to insert (default: 50000)");
+
+struct test_obj {
+	int			value;
+	struct rhash_head	node;
+};
+
+static struct rhashtable ht;
+static struct test_obj *objs;
+
+static unsigned int test_table_size(void)
+{
+	unsigned int size;
+
+	rcu_read_lock();
+	size = rht_dereference_rcu(ht.tbl, &ht)->size;
+	rcu_read_unlock();
+
+	return size;
+}
+
+/*
+ * The deferred worker resizes by one step per run, so keep running it
+ * until the table size settles.
+ */
+static unsigned int test_settle_size(void)
+{
+	unsigned int size, prev;
+
+	size = test_table_size();
+	do {
+		prev = size;
+		schedule_work(&ht.run_work);
+		flush_work(&ht.run_work);
+		size = test_table_size();
+	} while (size != prev);
+
+	return size;
+}
+
+static int test_lookup_all(bool present)
+{
+	struct test_obj *obj;
+	unsigned int i;
+	int err = 0;
+
+	rcu_read_lock();
+	for (i = 0; i < entries; i++) {
+		obj = rhashtable_lookup(&ht, &objs[i].value);
+		if (present ? obj != &objs[i] : obj != NULL) {
+			pr_err("lookup of %u: expected %p, got %p\n",
+			       i, present ? &objs[i] : NULL, obj);
+			err = -EINVAL;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return err;
+}
+
+static int __init test_rht_run(void)
+{
+	unsigned int i, size, initial_size;
+	ktime_t start;
+	s64 delta;
+	int err;
+
+	initial_size = test_table_size();
+
+	start = ktime_get();
+	for (i = 0; i < entries; i++) {
+		objs[i].value = i;
+		if (!rhashtable_lookup_insert(&ht, &objs[i].node)) {
+			pr_err("insertion of %u failed\n", i);
+			return -EINVAL;
+		}
+	}
+	delta = ktime_us_delta(ktime_get(), start);
+	pr_info("inserted %u entries in %lld us\n", entries, delta);
+
+	/* duplicates must be refused, wherever the original lives */
+	if (entries && rhashtable_lookup_insert(&ht, &objs[0].node)) {
+		pr_err("duplicate insertion succeeded\n");
+		return -EINVAL;
+	}
+
+	/* the smallest doubling of the initial size that is at most 75% full */
+	size = test_settle_size();
+	pr_info("table expanded to %u buckets\n", size);
+	if (entries > size / 4 * 3 ||
+	    (size > initial_size && entries <= size / 2 / 4 * 3)) {
+		pr_err("table of %u buckets is the wrong size for %u entries\n",
+		       size, entries);
+		return -EINVAL;
+	}
+
+	start = ktime_get();
+	err = test_lookup_all(true);
+	if (err)
+		return err;
+	delta = ktime_us_delta(ktime_get(), start);
+	pr_info("looked up %u entries in %lld us\n", entries, delta);
+
+	for (i = 0; i < entries; i++) {
+		if (!rhashtable_remove(&ht, &objs[i].node)) {
+			pr_err("removal of %u failed\n", i);
+			return -EINVAL;
+		}
+	}
+
+	err = test_lookup_all(false);
+	if (err)
+		return err;
+
+	size = test_settle_size();
+	pr_info("table shrunk to %u buckets\n", size);
+	if (size != ht.p.min_size) {
+		pr_err("empty table kept %u buckets, expected %u\n",
+		       size, ht.p.min_size);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int __init test_rht_init(void)
+{
+	struct rhashtable_params params = {
+		.nelem_hint = 8,
+		.head_offset = offsetof(struct test_obj, node),
+		.key_offset = offsetof(struct test_obj, value),
+		.key_len = sizeof(int),
+		.automatic_shrinking = true,
+	};
+	int err;
+
+	objs = vzalloc(entries * sizeof(*objs));
+	if (!objs)
+		return -ENOMEM;
+
+	err = rhashtable_init(&ht, &params);
+	if (err < 0) {
+		vfree(objs);
+		return err;
+	}
+
+	err = test_rht_run();
+
+	/* nothing looks at the entries anymore, no grace period needed */
+	rhashtable_destroy(&ht);
+	vfree(objs);
+
+	return err;
+}
+
+static void __exit test_rht_exit(void)
+{
+}
+
+module_init(test_rht_init);
+module_exit(test_rht_exit);
+
+MODULE_LICENSE("GPL");
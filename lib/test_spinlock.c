@@ -0,0 +1,171 @@
+/*
+ * Spinlock contention benchmark
+ *
+ * For 1, 2, 4, ... and finally all online CPUs, runs one kernel thread
+ * per CPU that repeatedly takes a shared spinlock, does a little work
+ * under it, drops it and does a little work outside of it. The total
+ * number of lock acquisitions per second is reported for every CPU
+ * count, which shows how throughput holds up as contention grows.
+ *
+ * The benchmark runs when the module is loaded, the load then fails on
+ * purpose so that there is nothing to unload.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/spinlock.h>
+#include <linux/jiffies.h>
+#include <linux/cpu.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+static unsigned int duration_ms = 1000;
+module_param(duration_ms, uint, 0444);
+MODULE_PARM_DESC(duration_ms, "Run time for each CPU count, in ms");
+
+static unsigned int hold_loops = 10;
+module_param(hold_loops, uint, 0444);
+MODULE_PARM_DESC(hold_loops, "Work done with the lock held");
+
+static unsigned int delay_loops = 100;
+module_param(delay_loops, uint, 0444);
+MODULE_PARM_DESC(delay_loops, "Work done between two lock acquisitions");
+
+static DEFINE_SPINLOCK(bench_lock);
+static unsigned long bench_counter;
+
+static unsigned long bench_end;
+static atomic_t bench_running;
+static DECLARE_COMPLETION(bench_done);
+
+struct bench_worker {
+	struct task_struct *task;
+	unsigned long long ops;
+} ____cacheline_aligned_in_smp;
+
+static int bench_thread(void *data)
+{
+	struct bench_worker *w = data;
+	unsigned long long ops = 0;
+	unsigned int i;
+
+	while (time_before(jiffies, ACCESS_ONCE(bench_end))) {
+		spin_lock(&bench_lock);
+		bench_counter++;
+		for (i = 0; i < hold_loops; i++)
+			cpu_relax();
+		spin_unlock(&bench_lock);
+
+		for (i = 0; i < delay_loops; i++)
+			cpu_relax();
+
+		/* let the loading thread run on !PREEMPT kernels */
+		if (!(++ops & 1023))
+			cond_resched();
+	}
+
+	w->ops = ops;
+	if (atomic_dec_and_test(&bench_running))
+		complete(&bench_done);
+
+	/* wait to be reaped by kthread_stop() */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static int run_bench(struct bench_worker *workers, unsigned int nr)
+{
+	unsigned long long total = 0;
+	unsigned int i = 0;
+	int cpu, err = 0;
+
+	for_each_online_cpu(cpu) {
+		if (i == nr)
+			break;
+		workers[i].ops = 0;
+		workers[i].task = kthread_create(bench_thread, &workers[i],
+						 "spinlock_bench/%d", cpu);
+		if (IS_ERR(workers[i].task)) {
+			err = PTR_ERR(workers[i].task);
+			break;
+		}
+		kthread_bind(workers[i].task, cpu);
+		i++;
+	}
+
+	if (err) {
+		while (i--)
+			kthread_stop(workers[i].task);
+		return err;
+	}
+
+	INIT_COMPLETION(bench_done);
+	atomic_set(&bench_running, nr);
+	bench_end = jiffies + msecs_to_jiffies(duration_ms);
+	for (i = 0; i < nr; i++)
+		wake_up_process(workers[i].task);
+
+	wait_for_completion(&bench_done);
+
+	for (i = 0; i < nr; i++) {
+		kthread_stop(workers[i].task);
+		total += workers[i].ops;
+	}
+
+	pr_info("%4u cpus: %12llu locks/s, %10llu locks/s per cpu\n", nr,
+		div_u64(total * 1000, duration_ms),
+		div_u64(total * 1000, duration_ms * nr));
+
+	return 0;
+}
+
+static int __init test_spinlock_init(void)
+{
+	struct bench_worker *workers;
+	unsigned int nr, max;
+	int err = 0;
+
+	if (!duration_ms)
+		return -EINVAL;
+
+	get_online_cpus();
+
+	max = num_online_cpus();
+	workers = kcalloc(max, sizeof(*workers), GFP_KERNEL);
+	if (!workers) {
+		put_online_cpus();
+		return -ENOMEM;
+	}
+
+	pr_info("%u ms per run, %u loops held, %u loops between locks\n",
+		duration_ms, hold_loops, delay_loops);
+
+	for (nr = 1; ; nr = min(nr * 2, max)) {
+		err = run_bench(workers, nr);
+		if (err || nr == max)
+			break;
+	}
+
+	put_online_cpus();
+	kfree(workers);
+
+	return err ? err : -EAGAIN;
+}
+module_init(test_spinlock_init);
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,192 @@
+/*
+ * Timer wheel benchmark
+ *
+ * Queues a large number of timers with the timeouts typical for TCP
+ * retransmission and keepalive timers, and measures the cost of
+ * add_timer(), mod_timer() and del_timer() on them. While the timers are
+ * pending, the timer softirq is timed through the softirq tracepoints
+ * and its longest run is reported, which is where the work of moving
+ * timers around the wheel shows up. Timers that expire during the run
+ * are checked not to have expired early.
+ *
+ * Everything happens at load time and every timer is deleted before
+ * init returns. Init reports -EINVAL when a timer fired early and
+ * -EAGAIN otherwise, which keeps the module from staying loaded.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/delay.h>
+#include <linux/interrupt.h>
+#include <linux/jiffies.h>
+#include <linux/percpu.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/timer.h>
+#include <linux/tracepoint.h>
+#include <linux/vmalloc.h>
+#include <trace/events/irq.h>
+
+static unsigned int nr_timers = 200000;
+module_param(nr_timers, uint, 0444);
+MODULE_PARM_DESC(nr_timers, "Number of timers (default: 200000)");
+
+static unsigned int hold_ms = 5000;
+module_param(hold_ms, uint, 0444);
+MODULE_PARM_DESC(hold_ms, "Time the timers stay queued, in ms (default: 5000)");
+
+static struct timer_list *timers;
+static atomic_t nr_expired;
+static atomic_t nr_early;
+
+static DEFINE_PER_CPU(u64, softirq_start);
+static DEFINE_PER_CPU(u64, softirq_max);
+static DEFINE_PER_CPU(unsigned long, softirq_runs);
+
+static void probe_softirq_entry(void *ignore, unsigned int vec_nr)
+{
+	if (vec_nr == TIMER_SOFTIRQ)
+		__this_cpu_write(softirq_start, local_clock());
+}
+
+static void probe_softirq_exit(void *ignore, unsigned int vec_nr)
+{
+	u64 start, delta;
+
+	if (vec_nr != TIMER_SOFTIRQ)
+		return;
+
+	start = __this_cpu_read(softirq_start);
+	if (!start)
+		return;
+
+	delta = local_clock() - start;
+	if (delta > __this_cpu_read(softirq_max))
+		__this_cpu_write(softirq_max, delta);
+	__this_cpu_inc(softirq_runs);
+}
+
+static void test_timer_fn(unsigned long data)
+{
+	struct timer_list *timer = &timers[data];
+
+	if (time_before(jiffies, timer->expires))
+		atomic_inc(&nr_early);
+	atomic_inc(&nr_expired);
+}
+
+/*
+ * Half of the timers look like retransmission timers, from 200 ms to
+ * 2 minutes, the other half like keepalive timers, around 2 hours.
+ */
+static unsigned long test_timeout(unsigned int i)
+{
+	if (i & 1)
+		return msecs_to_jiffies(7200 * MSEC_PER_SEC +
+					random32() % (60 * MSEC_PER_SEC));
+	return msecs_to_jiffies(200 + random32() % (120 * MSEC_PER_SEC));
+}
+
+static u64 test_ns_per_op(u64 start)
+{
+	return div_u64(local_clock() - start, nr_timers);
+}
+
+static void test_hold(void)
+{
+	unsigned long runs = 0;
+	u64 worst = 0;
+	int cpu, err;
+
+	for_each_possible_cpu(cpu) {
+		per_cpu(softirq_start, cpu) = 0;
+		per_cpu(softirq_max, cpu) = 0;
+		per_cpu(softirq_runs, cpu) = 0;
+	}
+
+	err = register_trace_softirq_entry(probe_softirq_entry, NULL);
+	if (!err) {
+		err = register_trace_softirq_exit(probe_softirq_exit, NULL);
+		if (err)
+			unregister_trace_softirq_entry(probe_softirq_entry,
+						       NULL);
+	}
+
+	msleep(hold_ms);
+
+	if (err) {
+		pr_info("no tracepoints (%d), timer softirq not measured\n",
+			err);
+		return;
+	}
+
+	unregister_trace_softirq_exit(probe_softirq_exit, NULL);
+	unregister_trace_softirq_entry(probe_softirq_entry, NULL);
+	tracepoint_synchronize_unregister();
+
+	for_each_possible_cpu(cpu) {
+		runs += per_cpu(softirq_runs, cpu);
+		worst = max(worst, per_cpu(softirq_max, cpu));
+	}
+	pr_info("timer softirq: %lu runs in %u ms, longest %llu us\n",
+		runs, hold_ms, div_u64(worst, NSEC_PER_USEC));
+}
+
+static int __init test_timer_wheel_init(void)
+{
+	unsigned int i;
+	u64 start;
+
+	if (!nr_timers)
+		return -EINVAL;
+
+	timers = vmalloc(nr_timers * sizeof(*timers));
+	if (!timers)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_timers; i++) {
+		setup_timer(&timers[i], test_timer_fn, i);
+		timers[i].expires = jiffies + test_timeout(i);
+	}
+
+	pr_info("%u timers, queued for %u ms\n", nr_timers, hold_ms);
+
+	start = local_clock();
+	for (i = 0; i < nr_timers; i++)
+		add_timer(&timers[i]);
+	pr_info("add_timer: %llu ns/op\n", test_ns_per_op(start));
+
+	start = local_clock();
+	for (i = 0; i < nr_timers; i++)
+		mod_timer(&timers[i], jiffies + test_timeout(i));
+	pr_info("mod_timer: %llu ns/op\n", test_ns_per_op(start));
+
+	test_hold();
+
+	start = local_clock();
+	for (i = 0; i < nr_timers; i++)
+		del_timer(&timers[i]);
+	pr_info("del_timer: %llu ns/op\n", test_ns_per_op(start));
+
+	for (i = 0; i < nr_timers; i++)
+		del_timer_sync(&timers[i]);
+	vfree(timers);
+
+	pr_info("%d timers expired\n", atomic_read(&nr_expired));
+	if (atomic_read(&nr_early)) {
+		pr_err("%d timers expired early\n", atomic_read(&nr_early));
+		return -EINVAL;
+	}
+
+	return -EAGAIN;
+}
+module_init(test_timer_wheel_init);
+
+MODULE_LICENSE("GPL");
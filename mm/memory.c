@@ -57,6 +57,7 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/migrate.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -3277,6 +3278,72 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * A NUMA hinting fault, left behind by change_prot_numa(): restore the
+ * vma protection, account the access to the task and, if the memory
+ * policy says the page belongs elsewhere, migrate it.
+ *
+ * We enter with non-exclusive mmap_sem and the pte mapped but not yet
+ * locked. We return with the pte unmapped and unlocked.
+ */
+static int do_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pte_t *page_table, pmd_t *pmd,
+		pte_t orig_pte)
+{
+	struct page *page;
+	spinlock_t *ptl;
+	int page_nid, target_nid;
+	bool migrated = false;
+	pte_t entry;
+
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	if (unlikely(!pte_same(*page_table, orig_pte))) {
+		pte_unmap_unlock(page_table, ptl);
+		return 0;
+	}
+
+	entry = pte_mkyoung(pte_modify(orig_pte, vma->vm_page_prot));
+	set_pte_at(mm, address, page_table, entry);
+	update_mmu_cache(vma, address, page_table);
+
+	page = vm_normal_page(vma, address, entry);
+	if (!page) {
+		pte_unmap_unlock(page_table, ptl);
+		return 0;
+	}
+	get_page(page);
+	pte_unmap_unlock(page_table, ptl);
+
+	count_vm_event(NUMA_HINT_FAULTS);
+	page_nid = page_to_nid(page);
+	if (page_nid == numa_node_id())
+		count_vm_event(NUMA_HINT_FAULTS_LOCAL);
+
+	target_nid = mpol_misplaced(page, vma, address);
+	if (target_nid == -1) {
+		put_page(page);
+	} else {
+		/* Drops the page reference */
+		migrated = migrate_misplaced_page(page, target_nid);
+		if (migrated)
+			page_nid = target_nid;
+	}
+
+	task_numa_fault(page_nid, 1, migrated);
+	return 0;
+}
+#else
+static inline int do_numa_page(struct mm_struct *mm,
+		struct vm_area_struct *vma, unsigned long address,
+		pte_t *page_table, pmd_t *pmd, pte_t orig_pte)
+{
+	BUG();
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * These routines also need to handle stuff like marking pages dirty
  * and/or accessed for architectures that don't do it in hardware (most
@@ -3315,6 +3382,9 @@ int handle_pte_fault(struct mm_struct *mm,
 					pte, pmd, flags, entry);
 	}
 
+	if (pte_numa(vma, entry))
+		return do_numa_page(mm, vma, address, pte, pmd, entry);
+
 	ptl = pte_lockptr(mm, pmd);
 	spin_lock(ptl);
 	if (unlikely(!pte_same(*pte, entry)))
@@ -1371,3 +1371,81 @@ int migrate_vmas(struct mm_struct *mm, const nodemask_t *to,
  	return err;
 }
 #endif
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Returns true if the node has a zone with enough free memory above the
+ * high watermark to take nr_pages without waking kswapd. Misplaced pages
+ * are not worth reclaiming for.
+ */
+static bool migrate_balanced_pgdat(struct pglist_data *pgdat,
+				   int nr_pages)
+{
+	int z;
+
+	for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+		struct zone *zone = pgdat->node_zones + z;
+
+		if (!populated_zone(zone) || zone->all_unreclaimable)
+			continue;
+		if (zone_watermark_ok(zone, 0,
+				high_wmark_pages(zone) + nr_pages, 0, 0))
+			return true;
+	}
+	return false;
+}
+
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long data,
+					     int **result)
+{
+	int nid = (int) data;
+
+	return alloc_pages_exact_node(nid,
+			(GFP_HIGHUSER_MOVABLE | __GFP_THISNODE |
+			 __GFP_NOMEMALLOC | __GFP_NORETRY | __GFP_NOWARN) &
+			~GFP_IOFS, 0);
+}
+
+/*
+ * Attempt to migrate a misplaced page, found by a NUMA hinting fault, to
+ * the specified node. The caller holds a reference on the page which is
+ * dropped here. Returns 1 if the page was migrated.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	LIST_HEAD(migratepages);
+	int nr_remaining;
+
+	/*
+	 * Pages mapped by several processes would just bounce between the
+	 * nodes their users run on, leave them where they are.
+	 */
+	if (page_mapcount(page) != 1 || PageTransHuge(page))
+		goto out;
+
+	if (!migrate_balanced_pgdat(NODE_DATA(node), 1))
+		goto out;
+
+	if (isolate_lru_page(page))
+		goto out;
+
+	inc_zone_page_state(page, NR_ISOLATED_ANON + page_is_file_cache(page));
+	list_add(&page->lru, &migratepages);
+	/* The isolation reference keeps the page */
+	put_page(page);
+
+	nr_remaining = migrate_pages(&migratepages, alloc_misplaced_dst_page,
+				     node, false, false);
+	if (nr_remaining) {
+		putback_lru_pages(&migratepages);
+		return 0;
+	}
+	count_vm_event(NUMA_PAGE_MIGRATE);
+	return 1;
+
+out:
+	put_page(page);
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
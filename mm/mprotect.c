@@ -141,6 +141,115 @@ static void change_protection(struct vm_area_struct *vma,
 	flush_tlb_range(vma, start, end);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+static unsigned long change_pte_range_numa(struct vm_area_struct *vma,
+		pmd_t *pmd, unsigned long addr, unsigned long end,
+		pgprot_t newprot)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long updated = 0;
+	pte_t *pte, oldpte;
+	spinlock_t *ptl;
+
+	pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	arch_enter_lazy_mmu_mode();
+	do {
+		pte_t ptent;
+
+		oldpte = *pte;
+		if (!pte_present(oldpte) || pte_numa(vma, oldpte))
+			continue;
+		/* Only pages that could be migrated are worth a fault */
+		if (!vm_normal_page(vma, addr, oldpte))
+			continue;
+
+		ptent = ptep_modify_prot_start(mm, addr, pte);
+		ptent = pte_modify(ptent, newprot);
+		ptep_modify_prot_commit(mm, addr, pte, ptent);
+		updated++;
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	arch_leave_lazy_mmu_mode();
+	pte_unmap_unlock(pte - 1, ptl);
+
+	return updated;
+}
+
+static inline unsigned long change_pmd_range_numa(struct vm_area_struct *vma,
+		pud_t *pud, unsigned long addr, unsigned long end,
+		pgprot_t newprot)
+{
+	unsigned long next, updated = 0;
+	pmd_t *pmd, pmdval;
+
+	pmd = pmd_offset(pud, addr);
+	do {
+		next = pmd_addr_end(addr, end);
+		/*
+		 * Only mmap_sem for read is held, so a huge pmd may be
+		 * instantiated under us: look at the pmd once and never
+		 * clear it. Transparent huge pages are not sampled.
+		 */
+		pmdval = *pmd;
+		barrier();
+		if (pmd_none(pmdval) || pmd_trans_huge(pmdval) ||
+		    unlikely(pmd_bad(pmdval)))
+			continue;
+		updated += change_pte_range_numa(vma, pmd, addr, next,
+						 newprot);
+	} while (pmd++, addr = next, addr != end);
+
+	return updated;
+}
+
+static inline unsigned long change_pud_range_numa(struct vm_area_struct *vma,
+		pgd_t *pgd, unsigned long addr, unsigned long end,
+		pgprot_t newprot)
+{
+	unsigned long next, updated = 0;
+	pud_t *pud;
+
+	pud = pud_offset(pgd, addr);
+	do {
+		next = pud_addr_end(addr, end);
+		if (pud_none_or_clear_bad(pud))
+			continue;
+		updated += change_pmd_range_numa(vma, pud, addr, next, newprot);
+	} while (pud++, addr = next, addr != end);
+
+	return updated;
+}
+
+/*
+ * Switch the present ptes in [start, end) to the PROT_NONE variant of
+ * the vma protection so that the next access to each page takes a NUMA
+ * hinting fault, see do_numa_page(). Called with mmap_sem held for read.
+ * Returns the number of ptes updated.
+ */
+unsigned long change_prot_numa(struct vm_area_struct *vma,
+			unsigned long start, unsigned long end)
+{
+	pgprot_t newprot = vma_prot_none(vma);
+	unsigned long addr = start, next, updated = 0;
+	pgd_t *pgd;
+
+	BUG_ON(start >= end);
+	pgd = pgd_offset(vma->vm_mm, addr);
+	flush_cache_range(vma, start, end);
+	do {
+		next = pgd_addr_end(addr, end);
+		if (pgd_none_or_clear_bad(pgd))
+			continue;
+		updated += change_pud_range_numa(vma, pgd, addr, next, newprot);
+	} while (pgd++, addr = next, addr != end);
+	if (updated) {
+		flush_tlb_range(vma, start, end);
+		count_vm_events(NUMA_PTE_UPDATES, updated);
+	}
+
+	return updated;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 int
 mprotect_fixup(struct vm_area_struct *vma, struct vm_area_struct **pprev,
 	unsigned long start, unsigned long end, unsigned long newflags)
@@ -18,6 +18,7 @@
 #include <linux/vmalloc.h>
 
 #include <net/request_sock.h>
+#include <net/tcp.h>
 
 /*
  * Maximum number of SYN_RECV sockets in queue per LISTEN socket.
@@ -57,9 +58,15 @@ int reqsk_queue_alloc(struct request_sock_queue *queue,
 	     lopt->max_qlen_log++);
 
 	get_random_bytes(&lopt->hash_rnd, sizeof(lopt->hash_rnd));
+	lopt->nr_table_entries = nr_table_entries;
+
+	/*
+	 * Only the accept queue starts afresh. fastopenq is set up once at
+	 * socket init and outlives listen(), as Fast Open children of an
+	 * earlier listen may still update it.
+	 */
 	rwlock_init(&queue->syn_wait_lock);
 	queue->rskq_accept_head = NULL;
-	lopt->nr_table_entries = nr_table_entries;
 
 	write_lock_bh(&queue->syn_wait_lock);
 	queue->listen_opt = lopt;
@@ -129,3 +136,65 @@ void reqsk_queue_destroy(struct request_sock_queue *queue)
 		kfree(lopt);
 }
 
+
+/*
+ * Called when a TCP Fast Open child socket no longer needs its request_sock,
+ * i.e. once the 3WHS has completed or has been aborted.
+ *
+ * A TFO child is created, and may be accepted, before the 3WHS completes,
+ * and it needs its request_sock until then, e.g. to retransmit the SYN-ACK.
+ * The request_sock is therefore only freed after BOTH the 3WHS has
+ * completed (or was aborted) AND the child has been accepted (or the
+ * listener was closed). Accepting the child sets req->sk to NULL, which is
+ * how this function tells whether the child was accepted.
+ *
+ * fastopen_rsk is only accessed by the child, under its socket lock, but
+ * the request_sock is also reachable from the listener's accept queue.
+ * Both sides synchronize on the listener's fastopenq.lock, which also
+ * protects fastopenq.qlen. The listener socket lock cannot be used as
+ * inet_csk_listen_stop() takes child locks while holding it.
+ *
+ * The request_sock holds a reference on its listener (treq->listener),
+ * dropped here.
+ */
+void reqsk_fastopen_remove(struct sock *sk, struct request_sock *req,
+			   bool reset)
+{
+	struct sock *lsk = tcp_rsk(req)->listener;
+	struct fastopen_queue *fastopenq =
+	    &inet_csk(lsk)->icsk_accept_queue.fastopenq;
+
+	tcp_sk(sk)->fastopen_rsk = NULL;
+	spin_lock_bh(&fastopenq->lock);
+	fastopenq->qlen--;
+	tcp_rsk(req)->listener = NULL;
+	if (req->sk)	/* the child socket hasn't been accepted yet */
+		goto out;
+
+	if (!reset || lsk->sk_state != TCP_LISTEN) {
+		/* If the listener has been closed don't bother with the
+		 * special RST handling below.
+		 */
+		spin_unlock_bh(&fastopenq->lock);
+		sock_put(lsk);
+		reqsk_free(req);
+		return;
+	}
+	/* Wait for 60secs before removing a req that has triggered RST.
+	 * This is a simple defense against TFO spoofing attack - by
+	 * counting the req against fastopen.max_qlen, and disabling
+	 * TFO when the qlen exceeds max_qlen.
+	 */
+	req->expires = jiffies + 60*HZ;
+	if (fastopenq->rskq_rst_head == NULL)
+		fastopenq->rskq_rst_head = req;
+	else
+		fastopenq->rskq_rst_tail->dl_next = req;
+
+	req->dl_next = NULL;
+	fastopenq->rskq_rst_tail = req;
+	fastopenq->qlen++;
+out:
+	spin_unlock_bh(&fastopenq->lock);
+	sock_put(lsk);
+}
@@ -47,7 +47,6 @@
 #include <linux/seq_file.h>
 #include <linux/notifier.h>
 #include <linux/security.h>
-#include <linux/jhash.h>
 #include <linux/jiffies.h>
 #include <linux/random.h>
 #include <linux/bitops.h>
@@ -55,6 +54,7 @@
 #include <linux/types.h>
 #include <linux/audit.h>
 #include <linux/mutex.h>
+#include <linux/rhashtable.h>
 
 #include <net/net_namespace.h>
 #include <net/sock.h>
@@ -81,6 +81,9 @@ struct netlink_sock {
 	struct mutex		cb_def_mutex;
 	void			(*netlink_rcv)(struct sk_buff *skb);
 	struct module		*module;
+
+	struct rhash_head	node;
+	struct rcu_head		rcu;
 };
 
 struct listeners {
@@ -103,21 +106,8 @@ static inline int netlink_is_kernel(struct sock *sk)
 	return nlk_sk(sk)->flags & NETLINK_KERNEL_SOCKET;
 }
 
-struct nl_pid_hash {
-	struct hlist_head *table;
-	unsigned long rehash_time;
-
-	unsigned int mask;
-	unsigned int shift;
-
-	unsigned int entries;
-	unsigned int max_shift;
-
-	u32 rnd;
-};
-
 struct netlink_table {
-	struct nl_pid_hash hash;
+	struct rhashtable hash;
 	struct hlist_head mc_list;
 	struct listeners __rcu *listeners;
 	unsigned int nl_nonroot;
@@ -137,6 +127,9 @@ static void netlink_destroy_callback(struct netlink_callback *cb);
 static DEFINE_RWLOCK(nl_table_lock);
 static atomic_t nl_table_users = ATOMIC_INIT(0);
 
+/* Serializes binds, so that a pid is checked and claimed atomically */
+static DEFINE_MUTEX(nl_sk_hash_lock);
+
 static ATOMIC_NOTIFIER_HEAD(netlink_chain);
 
 static u32 netlink_group_mask(u32 group)
@@ -144,11 +137,6 @@ static u32 netlink_group_mask(u32 group)
 	return group ? 1 << (group - 1) : 0;
 }
 
-static struct hlist_head *nl_pid_hashfn(struct nl_pid_hash *hash, u32 pid)
-{
-	return &hash->table[jhash_1word(pid, hash->rnd) & hash->mask];
-}
-
 static void netlink_sock_destruct(struct sock *sk)
 {
 	struct netlink_sock *nlk = nlk_sk(sk);
@@ -226,100 +214,48 @@ netlink_unlock_table(void)
 		wake_up(&nl_table_wait);
 }
 
-static inline struct sock *netlink_lookup(struct net *net, int protocol,
-					  u32 pid)
-{
-	struct nl_pid_hash *hash = &nl_table[protocol].hash;
-	struct hlist_head *head;
-	struct sock *sk;
-	struct hlist_node *node;
-
-	read_lock(&nl_table_lock);
-	head = nl_pid_hashfn(hash, pid);
-	sk_for_each(sk, node, head) {
-		if (net_eq(sock_net(sk), net) && (nlk_sk(sk)->pid == pid)) {
-			sock_hold(sk);
-			goto found;
-		}
-	}
-	sk = NULL;
-found:
-	read_unlock(&nl_table_lock);
-	return sk;
-}
+struct netlink_compare_arg {
+	struct net *net;
+	u32 pid;
+};
 
-static inline struct hlist_head *nl_pid_hash_zalloc(size_t size)
+static bool netlink_compare(void *ptr, void *arg)
 {
-	if (size <= PAGE_SIZE)
-		return kzalloc(size, GFP_ATOMIC);
-	else
-		return (struct hlist_head *)
-			__get_free_pages(GFP_ATOMIC | __GFP_ZERO,
-					 get_order(size));
-}
+	struct netlink_compare_arg *x = arg;
+	struct sock *sk = ptr;
 
-static inline void nl_pid_hash_free(struct hlist_head *table, size_t size)
-{
-	if (size <= PAGE_SIZE)
-		kfree(table);
-	else
-		free_pages((unsigned long)table, get_order(size));
+	return nlk_sk(sk)->pid == x->pid && net_eq(sock_net(sk), x->net);
 }
 
-static int nl_pid_hash_rehash(struct nl_pid_hash *hash, int grow)
+static struct sock *__netlink_lookup(struct netlink_table *table, u32 pid,
+				     struct net *net)
 {
-	unsigned int omask, mask, shift;
-	size_t osize, size;
-	struct hlist_head *otable, *table;
-	int i;
-
-	omask = mask = hash->mask;
-	osize = size = (mask + 1) * sizeof(*table);
-	shift = hash->shift;
-
-	if (grow) {
-		if (++shift > hash->max_shift)
-			return 0;
-		mask = mask * 2 + 1;
-		size *= 2;
-	}
-
-	table = nl_pid_hash_zalloc(size);
-	if (!table)
-		return 0;
-
-	otable = hash->table;
-	hash->table = table;
-	hash->mask = mask;
-	hash->shift = shift;
-	get_random_bytes(&hash->rnd, sizeof(hash->rnd));
-
-	for (i = 0; i <= omask; i++) {
-		struct sock *sk;
-		struct hlist_node *node, *tmp;
-
-		sk_for_each_safe(sk, node, tmp, &otable[i])
-			__sk_add_node(sk, nl_pid_hashfn(hash, nlk_sk(sk)->pid));
-	}
+	struct netlink_compare_arg arg = {
+		.net = net,
+		.pid = pid,
+	};
 
-	nl_pid_hash_free(otable, osize);
-	hash->rehash_time = jiffies + 10 * 60 * HZ;
-	return 1;
+	return rhashtable_lookup_compare(&table->hash, &pid,
+					 &netlink_compare, &arg);
 }
 
-static inline int nl_pid_hash_dilute(struct nl_pid_hash *hash, int len)
+/*
+ * Lookups don't take nl_table_lock: the socket table is RCU protected and
+ * a socket stays around for a grace period after it has been unhashed,
+ * see netlink_release().
+ */
+static struct sock *netlink_lookup(struct net *net, int protocol, u32 pid)
 {
-	int avg = hash->entries >> hash->shift;
-
-	if (unlikely(avg > 1) && nl_pid_hash_rehash(hash, 1))
-		return 1;
+	struct netlink_table *table = &nl_table[protocol];
+	struct sock *sk;
 
-	if (unlikely(len > avg) && time_after(jiffies, hash->rehash_time)) {
-		nl_pid_hash_rehash(hash, 0);
-		return 1;
-	}
+	rcu_read_lock();
+	sk = __netlink_lookup(table, pid, net);
+	if (sk)
+		sock_hold(sk);
+	rcu_read_unlock();
 
-	return 0;
+	return sk;
 }
 
 static const struct proto_ops netlink_ops;
@@ -346,49 +282,40 @@ netlink_update_listeners(struct sock *sk)
 
 static int netlink_insert(struct sock *sk, struct net *net, u32 pid)
 {
-	struct nl_pid_hash *hash = &nl_table[sk->sk_protocol].hash;
-	struct hlist_head *head;
+	struct netlink_table *table = &nl_table[sk->sk_protocol];
 	int err = -EADDRINUSE;
-	struct sock *osk;
-	struct hlist_node *node;
-	int len;
 
-	netlink_table_grab();
-	head = nl_pid_hashfn(hash, pid);
-	len = 0;
-	sk_for_each(osk, node, head) {
-		if (net_eq(sock_net(osk), net) && (nlk_sk(osk)->pid == pid))
-			break;
-		len++;
-	}
-	if (node)
+	mutex_lock(&nl_sk_hash_lock);
+	rcu_read_lock();
+	if (__netlink_lookup(table, pid, net)) {
+		rcu_read_unlock();
 		goto err;
+	}
+	rcu_read_unlock();
 
 	err = -EBUSY;
 	if (nlk_sk(sk)->pid)
 		goto err;
 
-	err = -ENOMEM;
-	if (BITS_PER_LONG > 32 && unlikely(hash->entries >= UINT_MAX))
-		goto err;
-
-	if (len && nl_pid_hash_dilute(hash, len))
-		head = nl_pid_hashfn(hash, pid);
-	hash->entries++;
 	nlk_sk(sk)->pid = pid;
-	sk_add_node(sk, head);
+	sock_hold(sk);
+	rhashtable_insert(&table->hash, &nlk_sk(sk)->node);
 	err = 0;
 
 err:
-	netlink_table_ungrab();
+	mutex_unlock(&nl_sk_hash_lock);
 	return err;
 }
 
 static void netlink_remove(struct sock *sk)
 {
+	struct netlink_table *table = &nl_table[sk->sk_protocol];
+
+	/* netlink_release() still holds a reference */
+	if (rhashtable_remove(&table->hash, &nlk_sk(sk)->node))
+		__sock_put(sk);
+
 	netlink_table_grab();
-	if (sk_del_node_init(sk))
-		nl_table[sk->sk_protocol].hash.entries--;
 	if (nlk_sk(sk)->subscriptions)
 		__sk_del_bind_node(sk);
 	netlink_table_ungrab();
@@ -481,6 +408,13 @@ out_module:
 	goto out;
 }
 
+static void deferred_put_nlk_sk(struct rcu_head *head)
+{
+	struct netlink_sock *nlk = container_of(head, struct netlink_sock, rcu);
+
+	sock_put(&nlk->sk);
+}
+
 static int netlink_release(struct socket *sock)
 {
 	struct sock *sk = sock->sk;
@@ -503,6 +437,20 @@ static int netlink_release(struct socket *sock)
 
 	skb_queue_purge(&sk->sk_write_queue);
 
+	/*
+	 * The last reference is dropped from an RCU callback, so finish an
+	 * unfinished dump here rather than let ->done() run in softirq
+	 * context from netlink_sock_destruct().
+	 */
+	mutex_lock(nlk->cb_mutex);
+	if (nlk->cb) {
+		if (nlk->cb->done)
+			nlk->cb->done(nlk->cb);
+		netlink_destroy_callback(nlk->cb);
+		nlk->cb = NULL;
+	}
+	mutex_unlock(nlk->cb_mutex);
+
 	if (nlk->pid) {
 		struct netlink_notify n = {
 						.net = sock_net(sk),
@@ -533,7 +481,12 @@ static int netlink_release(struct socket *sock)
 	local_bh_disable();
 	sock_prot_inuse_add(sock_net(sk), &netlink_proto, -1);
 	local_bh_enable();
-	sock_put(sk);
+
+	/*
+	 * Lookups may still be looking at the socket, drop the last
+	 * reference only once they are done with it.
+	 */
+	call_rcu(&nlk->rcu, deferred_put_nlk_sk);
 	return 0;
 }
 
@@ -541,31 +494,23 @@ static int netlink_autobind(struct socket *sock)
 {
 	struct sock *sk = sock->sk;
 	struct net *net = sock_net(sk);
-	struct nl_pid_hash *hash = &nl_table[sk->sk_protocol].hash;
-	struct hlist_head *head;
-	struct sock *osk;
-	struct hlist_node *node;
+	struct netlink_table *table = &nl_table[sk->sk_protocol];
 	s32 pid = task_tgid_vnr(current);
 	int err;
 	static s32 rover = -4097;
 
 retry:
 	cond_resched();
-	netlink_table_grab();
-	head = nl_pid_hashfn(hash, pid);
-	sk_for_each(osk, node, head) {
-		if (!net_eq(sock_net(osk), net))
-			continue;
-		if (nlk_sk(osk)->pid == pid) {
-			/* Bind collision, search negative pid values. */
-			pid = rover--;
-			if (rover > -4097)
-				rover = -4097;
-			netlink_table_ungrab();
-			goto retry;
-		}
+	rcu_read_lock();
+	if (__netlink_lookup(table, pid, net)) {
+		/* Bind collision, search negative pid values. */
+		pid = rover--;
+		if (rover > -4097)
+			rover = -4097;
+		rcu_read_unlock();
+		goto retry;
 	}
-	netlink_table_ungrab();
+	rcu_read_unlock();
 
 	err = netlink_insert(sk, net, pid);
 	if (err == -EADDRINUSE)
@@ -1898,37 +1843,56 @@ struct nl_seq_iter {
 	int hash_idx;
 };
 
+/* First socket of @seq's namespace in the chain starting at @he */
+static struct sock *netlink_seq_skip(struct seq_file *seq,
+				     struct rhash_head *he)
+{
+	struct sock *s;
+
+	for (; he; he = rcu_dereference(he->next)) {
+		s = &container_of(he, struct netlink_sock, node)->sk;
+		if (net_eq(sock_net(s), seq_file_net(seq)))
+			return s;
+	}
+	return NULL;
+}
+
 static struct sock *netlink_seq_socket_idx(struct seq_file *seq, loff_t pos)
 {
 	struct nl_seq_iter *iter = seq->private;
 	int i, j;
 	struct sock *s;
-	struct hlist_node *node;
 	loff_t off = 0;
 
 	for (i = 0; i < MAX_LINKS; i++) {
-		struct nl_pid_hash *hash = &nl_table[i].hash;
+		struct rhashtable *ht = &nl_table[i].hash;
+		const struct bucket_table *tbl = rht_dereference_rcu(ht->tbl, ht);
 
-		for (j = 0; j <= hash->mask; j++) {
-			sk_for_each(s, node, &hash->table[j]) {
-				if (sock_net(s) != seq_file_net(seq))
-					continue;
+		for (j = 0; j < tbl->size; j++) {
+			s = netlink_seq_skip(seq, rcu_dereference(tbl->buckets[j]));
+			while (s) {
 				if (off == pos) {
 					iter->link = i;
 					iter->hash_idx = j;
 					return s;
 				}
 				++off;
+				s = netlink_seq_skip(seq,
+					rcu_dereference(nlk_sk(s)->node.next));
 			}
 		}
 	}
 	return NULL;
 }
 
+/*
+ * The table may be resized while it is being dumped, sockets that move
+ * between buckets meanwhile can be missed or shown twice.
+ */
 static void *netlink_seq_start(struct seq_file *seq, loff_t *pos)
-	__acquires(nl_table_lock)
+	__acquires(RCU)
 {
-	read_lock(&nl_table_lock);
+	rcu_read_lock();
 	return *pos ? netlink_seq_socket_idx(seq, *pos - 1) : SEQ_START_TOKEN;
 }
 
@@ -1944,10 +1908,7 @@ static void *netlink_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 		return netlink_seq_socket_idx(seq, 0);
 
 	iter = seq->private;
-	s = v;
-	do {
-		s = sk_next(s);
-	} while (s && sock_net(s) != seq_file_net(seq));
+	s = netlink_seq_skip(seq, rcu_dereference(nlk_sk(v)->node.next));
 	if (s)
 		return s;
 
@@ -1955,12 +1916,11 @@ static void *netlink_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 	j = iter->hash_idx + 1;
 
 	do {
-		struct nl_pid_hash *hash = &nl_table[i].hash;
+		struct rhashtable *ht = &nl_table[i].hash;
+		const struct bucket_table *tbl = rht_dereference_rcu(ht->tbl, ht);
 
-		for (; j <= hash->mask; j++) {
-			s = sk_head(&hash->table[j]);
-			while (s && sock_net(s) != seq_file_net(seq))
-				s = sk_next(s);
+		for (; j < tbl->size; j++) {
+			s = netlink_seq_skip(seq, rcu_dereference(tbl->buckets[j]));
 			if (s) {
 				iter->link = i;
 				iter->hash_idx = j;
@@ -1975,9 +1935,9 @@ static void *netlink_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 }
 
 static void netlink_seq_stop(struct seq_file *seq, void *v)
-	__releases(nl_table_lock)
+	__releases(RCU)
 {
-	read_unlock(&nl_table_lock);
+	rcu_read_unlock();
 }
 
 
@@ -2117,6 +2077,12 @@ static int __init netlink_proto_init(void)
 	int i;
 	unsigned long limit;
 	unsigned int order;
+	struct rhashtable_params ht_params = {
+		.head_offset = offsetof(struct netlink_sock, node),
+		.key_offset = offsetof(struct netlink_sock, pid),
+		.key_len = sizeof(u32), /* pid */
+		.automatic_shrinking = true,
+	};
 	int err = proto_register(&netlink_proto, 0);
 
 	if (err != 0)
@@ -2136,22 +2102,15 @@ static int __init netlink_proto_init(void)
 	order = get_bitmask_order(limit) - 1 + PAGE_SHIFT;
 	limit = (1UL << order) / sizeof(struct hlist_head);
 	order = get_bitmask_order(min(limit, (unsigned long)UINT_MAX)) - 1;
+	ht_params.max_size = 1U << order;
 
 	for (i = 0; i < MAX_LINKS; i++) {
-		struct nl_pid_hash *hash = &nl_table[i].hash;
-
-		hash->table = nl_pid_hash_zalloc(1 * sizeof(*hash->table));
-		if (!hash->table) {
+		if (rhashtable_init(&nl_table[i].hash, &ht_params) < 0) {
 			while (i-- > 0)
-				nl_pid_hash_free(nl_table[i].hash.table,
-						 1 * sizeof(*hash->table));
+				rhashtable_destroy(&nl_table[i].hash);
 			kfree(nl_table);
 			goto panic;
 		}
-		hash->max_shift = order;
-		hash->shift = 0;
-		hash->mask = 0;
-		hash->rehash_time = jiffies;
 	}
 
 	netlink_add_usersock_entry();
@@ -161,13 +161,56 @@ struct packet_mreq_max {
 	unsigned char	mr_address[MAX_ADDR_LEN];
 };
 
-static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
+static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 		int closing, int tx_ring);
 
+#define V3_ALIGNMENT	(8)
+
+#define BLK_HDR_LEN	(ALIGN(sizeof(struct tpacket_block_desc), V3_ALIGNMENT))
+
+#define BLK_PLUS_PRIV(sz_of_priv) \
+	(BLK_HDR_LEN + ALIGN((sz_of_priv), V3_ALIGNMENT))
+
+/* Default TPACKET_V3 block retire timeout, in msecs */
+#define DEFAULT_PRB_RETIRE_TOV	(8)
+
 struct pgv {
 	char *buffer;
 };
 
+/* kbdq - kernel block descriptor queue, the TPACKET_V3 rx ring state */
+struct tpacket_kbdq_core {
+	struct pgv	*pkbdq;
+	unsigned int	feature_req_word;
+	unsigned int	knum_blocks;
+	unsigned int	kblk_size;
+	unsigned int	blk_sizeof_priv;
+	unsigned int	max_frame_len;
+	unsigned int	kactive_blk_num;
+
+	/*
+	 * Block that was active when the retire timer last fired.  If it
+	 * is still active on the next expiry, the block is retired.
+	 */
+	unsigned int	last_kactive_blk_num;
+
+	unsigned char	reset_pending_on_curr_blk;	/* queue is frozen */
+	unsigned char	delete_blk_timer;
+
+	char		*pkblk_start;
+	char		*pkblk_end;
+	char		*prev;
+	char		*nxt_offset;
+	u64		knxt_seq_num;
+
+	/* frames reserved in the current block but not yet filled in */
+	atomic_t	blk_fill_in_prog;
+
+	unsigned int	retire_blk_tov;
+	unsigned long	tov_in_jiffies;
+	struct timer_list retire_blk_timer;
+};
+
 struct packet_ring_buffer {
 	struct pgv		*pg_vec;
 	unsigned int		head;
@@ -179,18 +222,23 @@ struct packet_ring_buffer {
 	unsigned int		pg_vec_pages;
 	unsigned int		pg_vec_len;
 
+	struct tpacket_kbdq_core	prb_bdqc;
 	atomic_t		pending;
 };
 
+#define GET_PBDQC_FROM_RB(x)	(&(x)->prb_bdqc)
+
 struct packet_sock;
 static int tpacket_snd(struct packet_sock *po, struct msghdr *msg);
 
 static void packet_flush_mclist(struct sock *sk);
 
+struct packet_fanout;
 struct packet_sock {
 	/* struct sock has to be the first member of packet_sock */
 	struct sock		sk;
-	struct tpacket_stats	stats;
+	struct packet_fanout	*fanout;
+	union  tpacket_stats_u	stats;
 	struct packet_ring_buffer	rx_ring;
 	struct packet_ring_buffer	tx_ring;
 	int			copy_thresh;
@@ -212,6 +260,23 @@ struct packet_sock {
 	struct packet_type	prot_hook ____cacheline_aligned_in_smp;
 };
 
+#define PACKET_FANOUT_MAX	256
+
+struct packet_fanout {
+#ifdef CONFIG_NET_NS
+	struct net		*net;
+#endif
+	unsigned int		num_members;
+	u16			id;
+	u8			type;
+	atomic_t		rr_cur;
+	struct list_head	list;
+	struct sock		*arr[PACKET_FANOUT_MAX];
+	spinlock_t		lock;
+	atomic_t		sk_ref;
+	struct packet_type	prot_hook ____cacheline_aligned_in_smp;
+};
+
 struct packet_skb_cb {
 	unsigned int origlen;
 	union {
@@ -222,6 +287,64 @@ struct packet_skb_cb {
 
 #define PACKET_SKB_CB(__skb)	((struct packet_skb_cb *)((__skb)->cb))
 
+static inline struct packet_sock *pkt_sk(struct sock *sk)
+{
+	return (struct packet_sock *)sk;
+}
+
+static void __fanout_unlink(struct sock *sk, struct packet_sock *po);
+static void __fanout_link(struct sock *sk, struct packet_sock *po);
+
+/* register_prot_hook must be invoked with the po->bind_lock held,
+ * or from a context in which asynchronous accesses to the packet
+ * socket is not possible (packet_create()).
+ */
+static void register_prot_hook(struct sock *sk)
+{
+	struct packet_sock *po = pkt_sk(sk);
+	if (!po->running) {
+		if (po->fanout)
+			__fanout_link(sk, po);
+		else
+			dev_add_pack(&po->prot_hook);
+		sock_hold(sk);
+		po->running = 1;
+	}
+}
+
+/* {,__}unregister_prot_hook() must be invoked with the po->bind_lock
+ * held.   If the sync parameter is true, we will temporarily drop
+ * the po->bind_lock and do a synchronize_net to make sure no
+ * asynchronous packet processing paths still refer to the elements
+ * of po->prot_hook.  If the sync parameter is false, it is the
+ * callers responsibility to take care of this.
+ */
+static void __unregister_prot_hook(struct sock *sk, bool sync)
+{
+	struct packet_sock *po = pkt_sk(sk);
+
+	po->running = 0;
+	if (po->fanout)
+		__fanout_unlink(sk, po);
+	else
+		__dev_remove_pack(&po->prot_hook);
+	__sock_put(sk);
+
+	if (sync) {
+		spin_unlock(&po->bind_lock);
+		synchronize_net();
+		spin_lock(&po->bind_lock);
+	}
+}
+
+static void unregister_prot_hook(struct sock *sk, bool sync)
+{
+	struct packet_sock *po = pkt_sk(sk);
+
+	if (po->running)
+		__unregister_prot_hook(sk, sync);
+}
+
 static inline __pure struct page *pgv_to_page(void *addr)
 {
 	if (is_vmalloc_addr(addr))
@@ -324,9 +447,256 @@ static inline void packet_increment_head(struct packet_ring_buffer *buff)
 	buff->head = buff->head != buff->frame_max ? buff->head+1 : 0;
 }
 
-static inline struct packet_sock *pkt_sk(struct sock *sk)
+/*
+ * TPACKET_V3 rx ring.
+ *
+ * The ring is made of tp_block_nr blocks.  The kernel packs frames of
+ * variable size back to back into the current block, and hands the whole
+ * block over to user space (TP_STATUS_USER in its block descriptor) once
+ * it is full or has been open for retire_blk_tov msecs.  If the next
+ * block is still owned by user space, the queue is frozen and packets are
+ * dropped until that block is given back.
+ *
+ * All state changes happen under sk_receive_queue.lock.  Frames are
+ * reserved under the lock and filled in outside of it; blk_fill_in_prog
+ * keeps a block from being retired while a fill is still in flight.
+ */
+
+static inline struct tpacket_block_desc *prb_block(
+		struct tpacket_kbdq_core *pkc, unsigned int idx)
 {
-	return (struct packet_sock *)sk;
+	return (struct tpacket_block_desc *)pkc->pkbdq[idx].buffer;
+}
+
+static inline struct tpacket_block_desc *prb_curr_block(
+		struct tpacket_kbdq_core *pkc)
+{
+	return prb_block(pkc, pkc->kactive_blk_num);
+}
+
+static inline unsigned int prb_prev_blk_num(struct tpacket_kbdq_core *pkc)
+{
+	return pkc->kactive_blk_num ? pkc->kactive_blk_num - 1 :
+				      pkc->knum_blocks - 1;
+}
+
+static inline unsigned int prb_next_blk_num(struct tpacket_kbdq_core *pkc)
+{
+	return pkc->kactive_blk_num < pkc->knum_blocks - 1 ?
+				pkc->kactive_blk_num + 1 : 0;
+}
+
+static u32 prb_block_status(struct tpacket_block_desc *pbd)
+{
+	smp_rmb();
+	flush_dcache_page(pgv_to_page(&pbd->hdr.bh1.block_status));
+	return pbd->hdr.bh1.block_status;
+}
+
+static void prb_open_block(struct tpacket_kbdq_core *pkc,
+			   struct tpacket_block_desc *pbd)
+{
+	struct tpacket_hdr_v1 *h1 = &pbd->hdr.bh1;
+	struct timespec ts;
+
+	pbd->version = TPACKET_V3;
+	pbd->offset_to_priv = BLK_HDR_LEN;
+
+	h1->num_pkts = 0;
+	h1->offset_to_first_pkt = BLK_PLUS_PRIV(pkc->blk_sizeof_priv);
+	h1->blk_len = h1->offset_to_first_pkt;
+	h1->seq_num = pkc->knxt_seq_num++;
+	getnstimeofday(&ts);
+	h1->ts_first_pkt.ts_sec = ts.tv_sec;
+	h1->ts_first_pkt.ts_nsec = ts.tv_nsec;
+
+	pkc->pkblk_start = (char *)pbd;
+	pkc->pkblk_end = pkc->pkblk_start + pkc->kblk_size;
+	pkc->nxt_offset = pkc->pkblk_start + h1->offset_to_first_pkt;
+	pkc->prev = pkc->nxt_offset;
+	pkc->reset_pending_on_curr_blk = 0;
+}
+
+/* Hand the current block over to user space and move to the next one. */
+static void prb_close_block(struct tpacket_kbdq_core *pkc,
+			    struct tpacket_block_desc *pbd,
+			    struct packet_sock *po, u32 status)
+{
+	struct tpacket_hdr_v1 *h1 = &pbd->hdr.bh1;
+	struct sock *sk = &po->sk;
+
+	/* Wait for frames still being copied in on other cpus */
+	while (atomic_read(&pkc->blk_fill_in_prog))
+		cpu_relax();
+
+	if (po->stats.stats3.tp_drops)
+		status |= TP_STATUS_LOSING;
+
+	if (h1->num_pkts) {
+		struct tpacket3_hdr *last_pkt = (struct tpacket3_hdr *)pkc->prev;
+
+		h1->ts_last_pkt.ts_sec = last_pkt->tp_sec;
+		h1->ts_last_pkt.ts_nsec = last_pkt->tp_nsec;
+	} else {
+		struct timespec ts;
+
+		getnstimeofday(&ts);
+		h1->ts_last_pkt.ts_sec = ts.tv_sec;
+		h1->ts_last_pkt.ts_nsec = ts.tv_nsec;
+	}
+	h1->blk_len = pkc->nxt_offset - pkc->pkblk_start;
+
+#if ARCH_IMPLEMENTS_FLUSH_DCACHE_PAGE == 1
+	{
+		u8 *start;
+
+		for (start = (u8 *)pbd; start < (u8 *)pkc->pkblk_end;
+		     start += PAGE_SIZE)
+			flush_dcache_page(pgv_to_page(start));
+	}
+#endif
+	smp_wmb();
+
+	h1->block_status = TP_STATUS_USER | status;
+	flush_dcache_page(pgv_to_page(&h1->block_status));
+	smp_wmb();
+
+	sk->sk_data_ready(sk, 0);
+
+	pkc->kactive_blk_num = prb_next_blk_num(pkc);
+}
+
+/*
+ * Open the block following a retired one, or freeze the queue if user
+ * space has not released it yet.
+ */
+static struct tpacket_block_desc *prb_dispatch_next_block(
+		struct tpacket_kbdq_core *pkc, struct packet_sock *po)
+{
+	struct tpacket_block_desc *pbd = prb_curr_block(pkc);
+
+	if (prb_block_status(pbd) != TP_STATUS_KERNEL) {
+		if (!pkc->reset_pending_on_curr_blk) {
+			pkc->reset_pending_on_curr_blk = 1;
+			po->stats.stats3.tp_freeze_q_cnt++;
+		}
+		return NULL;
+	}
+
+	prb_open_block(pkc, pbd);
+	return pbd;
+}
+
+static void *__packet_lookup_frame_in_block(struct packet_sock *po,
+					    unsigned int len)
+{
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
+	struct tpacket_block_desc *pbd = prb_curr_block(pkc);
+	struct tpacket3_hdr *prev;
+	char *curr;
+
+	len = ALIGN(len, V3_ALIGNMENT);
+	if (unlikely(len > pkc->max_frame_len))
+		return NULL;
+
+	if (pkc->reset_pending_on_curr_blk) {
+		pbd = prb_dispatch_next_block(pkc, po);
+		if (!pbd)
+			return NULL;
+	}
+
+	if (pkc->nxt_offset + len > pkc->pkblk_end) {
+		prb_close_block(pkc, pbd, po, 0);
+		pbd = prb_dispatch_next_block(pkc, po);
+		if (!pbd)
+			return NULL;
+	}
+
+	curr = pkc->nxt_offset;
+	prev = (struct tpacket3_hdr *)pkc->prev;
+	prev->tp_next_offset = curr - pkc->prev;
+	((struct tpacket3_hdr *)curr)->tp_next_offset = 0;
+	pkc->prev = curr;
+	pkc->nxt_offset += len;
+	pbd->hdr.bh1.num_pkts++;
+	atomic_inc(&pkc->blk_fill_in_prog);
+
+	return curr;
+}
+
+static void prb_clear_blk_fill_status(struct packet_ring_buffer *rb)
+{
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(rb);
+
+	smp_mb__before_atomic_dec();
+	atomic_dec(&pkc->blk_fill_in_prog);
+}
+
+static void prb_retire_rx_blk_timer_expired(unsigned long data)
+{
+	struct packet_sock *po = (struct packet_sock *)data;
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
+	struct tpacket_block_desc *pbd;
+
+	spin_lock(&po->sk.sk_receive_queue.lock);
+
+	if (unlikely(pkc->delete_blk_timer))
+		goto out;
+
+	pbd = prb_curr_block(pkc);
+	if (pkc->reset_pending_on_curr_blk) {
+		/* Frozen: reopen as soon as user space gives the block back */
+		prb_dispatch_next_block(pkc, po);
+	} else if (pkc->last_kactive_blk_num == pkc->kactive_blk_num &&
+		   pbd->hdr.bh1.num_pkts) {
+		/* Block has been open for a whole period */
+		prb_close_block(pkc, pbd, po, TP_STATUS_BLK_TMO);
+		prb_dispatch_next_block(pkc, po);
+	}
+
+	pkc->last_kactive_blk_num = pkc->kactive_blk_num;
+	mod_timer(&pkc->retire_blk_timer, jiffies + pkc->tov_in_jiffies);
+out:
+	spin_unlock(&po->sk.sk_receive_queue.lock);
+}
+
+static void prb_shutdown_retire_blk_timer(struct packet_sock *po,
+					  struct sk_buff_head *rb_queue)
+{
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
+
+	spin_lock_bh(&rb_queue->lock);
+	pkc->delete_blk_timer = 1;
+	spin_unlock_bh(&rb_queue->lock);
+
+	del_timer_sync(&pkc->retire_blk_timer);
+}
+
+static void init_prb_bdqc(struct packet_sock *po,
+			  struct packet_ring_buffer *rb,
+			  struct tpacket_req3 *req3)
+{
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(rb);
+
+	memset(pkc, 0, sizeof(*pkc));
+
+	pkc->pkbdq = rb->pg_vec;
+	pkc->knum_blocks = req3->tp_block_nr;
+	pkc->kblk_size = req3->tp_block_size;
+	pkc->blk_sizeof_priv = req3->tp_sizeof_priv;
+	pkc->max_frame_len = pkc->kblk_size - BLK_PLUS_PRIV(pkc->blk_sizeof_priv);
+	pkc->feature_req_word = req3->tp_feature_req_word;
+	atomic_set(&pkc->blk_fill_in_prog, 0);
+
+	pkc->retire_blk_tov = req3->tp_retire_blk_tov ? :
+			      DEFAULT_PRB_RETIRE_TOV;
+	pkc->tov_in_jiffies = msecs_to_jiffies(pkc->retire_blk_tov) ? : 1;
+
+	prb_open_block(pkc, prb_curr_block(pkc));
+
+	setup_timer(&pkc->retire_blk_timer, prb_retire_rx_blk_timer_expired,
+		    (unsigned long)po);
+	mod_timer(&pkc->retire_blk_timer, jiffies + pkc->tov_in_jiffies);
 }
 
 static void packet_sock_destruct(struct sock *sk)
@@ -344,6 +714,195 @@ static void packet_sock_destruct(struct sock *sk)
 	sk_refcnt_debug_dec(sk);
 }
 
+/*
+ * Fanout groups: several packet sockets bound to the same device and
+ * protocol share one packet_type, and each frame is handed to exactly
+ * one member of the group.
+ */
+
+static DEFINE_MUTEX(fanout_mutex);
+static LIST_HEAD(fanout_list);
+
+static struct sock *fanout_demux_hash(struct packet_fanout *f,
+				      struct sk_buff *skb, unsigned int num)
+{
+	u32 idx, hash = skb_get_rxhash(skb);
+
+	idx = ((u64)hash * num) >> 32;
+
+	return f->arr[idx];
+}
+
+static struct sock *fanout_demux_lb(struct packet_fanout *f,
+				    struct sk_buff *skb, unsigned int num)
+{
+	unsigned int cur = atomic_inc_return(&f->rr_cur);
+
+	return f->arr[cur % num];
+}
+
+static struct sock *fanout_demux_cpu(struct packet_fanout *f,
+				     struct sk_buff *skb, unsigned int num)
+{
+	unsigned int cpu = smp_processor_id();
+
+	return f->arr[cpu % num];
+}
+
+static int packet_rcv_fanout(struct sk_buff *skb, struct net_device *dev,
+			     struct packet_type *pt, struct net_device *orig_dev)
+{
+	struct packet_fanout *f = pt->af_packet_priv;
+	unsigned int num = ACCESS_ONCE(f->num_members);
+	struct packet_sock *po;
+	struct sock *sk;
+
+	if (!net_eq(dev_net(dev), read_pnet(&f->net)) ||
+	    !num) {
+		kfree_skb(skb);
+		return 0;
+	}
+	/* Pairs with the smp_wmb() in __fanout_link() */
+	smp_rmb();
+
+	switch (f->type) {
+	case PACKET_FANOUT_HASH:
+	default:
+		sk = fanout_demux_hash(f, skb, num);
+		break;
+	case PACKET_FANOUT_LB:
+		sk = fanout_demux_lb(f, skb, num);
+		break;
+	case PACKET_FANOUT_CPU:
+		sk = fanout_demux_cpu(f, skb, num);
+		break;
+	}
+
+	po = pkt_sk(sk);
+
+	return po->prot_hook.func(skb, dev, &po->prot_hook, orig_dev);
+}
+
+static void __fanout_link(struct sock *sk, struct packet_sock *po)
+{
+	struct packet_fanout *f = po->fanout;
+
+	spin_lock(&f->lock);
+	f->arr[f->num_members] = sk;
+	smp_wmb();
+	f->num_members++;
+	spin_unlock(&f->lock);
+}
+
+static void __fanout_unlink(struct sock *sk, struct packet_sock *po)
+{
+	struct packet_fanout *f = po->fanout;
+	int i;
+
+	spin_lock(&f->lock);
+	for (i = 0; i < f->num_members; i++) {
+		if (f->arr[i] == sk)
+			break;
+	}
+	BUG_ON(i >= f->num_members);
+	f->arr[i] = f->arr[f->num_members - 1];
+	f->num_members--;
+	spin_unlock(&f->lock);
+}
+
+static int fanout_add(struct sock *sk, u16 id, u16 type)
+{
+	struct packet_sock *po = pkt_sk(sk);
+	struct packet_fanout *f, *match;
+	int err;
+
+	switch (type) {
+	case PACKET_FANOUT_HASH:
+	case PACKET_FANOUT_LB:
+	case PACKET_FANOUT_CPU:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (po->fanout)
+		return -EALREADY;
+
+	mutex_lock(&fanout_mutex);
+	match = NULL;
+	list_for_each_entry(f, &fanout_list, list) {
+		if (f->id == id &&
+		    read_pnet(&f->net) == sock_net(sk)) {
+			match = f;
+			break;
+		}
+	}
+	if (!match) {
+		err = -ENOMEM;
+		match = kzalloc(sizeof(*match), GFP_KERNEL);
+		if (!match)
+			goto out;
+		write_pnet(&match->net, sock_net(sk));
+		match->id = id;
+		match->type = type;
+		atomic_set(&match->rr_cur, 0);
+		INIT_LIST_HEAD(&match->list);
+		spin_lock_init(&match->lock);
+		atomic_set(&match->sk_ref, 0);
+		match->prot_hook.type = po->prot_hook.type;
+		match->prot_hook.dev = po->prot_hook.dev;
+		match->prot_hook.func = packet_rcv_fanout;
+		match->prot_hook.af_packet_priv = match;
+		dev_add_pack(&match->prot_hook);
+		list_add(&match->list, &fanout_list);
+	}
+
+	spin_lock(&po->bind_lock);
+	err = -EINVAL;
+	if (po->running &&
+	    match->type == type &&
+	    match->prot_hook.type == po->prot_hook.type &&
+	    match->prot_hook.dev == po->prot_hook.dev) {
+		err = -ENOSPC;
+		if (atomic_read(&match->sk_ref) < PACKET_FANOUT_MAX) {
+			__dev_remove_pack(&po->prot_hook);
+			po->fanout = match;
+			atomic_inc(&match->sk_ref);
+			__fanout_link(sk, po);
+			err = 0;
+		}
+	}
+	spin_unlock(&po->bind_lock);
+
+	if (err && !atomic_read(&match->sk_ref)) {
+		list_del(&match->list);
+		dev_remove_pack(&match->prot_hook);
+		kfree(match);
+	}
+out:
+	mutex_unlock(&fanout_mutex);
+	return err;
+}
+
+static void fanout_release(struct sock *sk)
+{
+	struct packet_sock *po = pkt_sk(sk);
+	struct packet_fanout *f;
+
+	f = po->fanout;
+	if (!f)
+		return;
+
+	po->fanout = NULL;
+
+	mutex_lock(&fanout_mutex);
+	if (atomic_dec_and_test(&f->sk_ref)) {
+		list_del(&f->list);
+		dev_remove_pack(&f->prot_hook);
+		kfree(f);
+	}
+	mutex_unlock(&fanout_mutex);
+}
 
 static const struct proto_ops packet_ops;
 
@@ -538,7 +1097,7 @@ static inline unsigned int run_filter(const struct sk_buff *skb,
 	rcu_read_lock();
 	filter = rcu_dereference(sk->sk_filter);
 	if (filter != NULL)
-		res = sk_run_filter(skb, filter->insns);
+		res = SK_RUN_FILTER(filter, skb);
 	rcu_read_unlock();
 
 	return res;
@@ -646,7 +1205,7 @@ static int packet_rcv(struct sk_buff *skb, struct net_device *dev,
 	nf_reset(skb);
 
 	spin_lock(&sk->sk_receive_queue.lock);
-	po->stats.tp_packets++;
+	po->stats.stats1.tp_packets++;
 	skb->dropcount = atomic_read(&sk->sk_drops);
 	__skb_queue_tail(&sk->sk_receive_queue, skb);
 	spin_unlock(&sk->sk_receive_queue.lock);
@@ -654,7 +1213,7 @@ static int packet_rcv(struct sk_buff *skb, struct net_device *dev,
 	return 0;
 
 drop_n_acct:
-	po->stats.tp_drops = atomic_inc_return(&sk->sk_drops);
+	po->stats.stats1.tp_drops = atomic_inc_return(&sk->sk_drops);
 
 drop_n_restore:
 	if (skb_head != skb->data && skb_shared(skb)) {
@@ -675,6 +1234,7 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} h;
 	u8 *skb_head = skb->data;
@@ -727,7 +1287,8 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 		macoff = netoff - maclen;
 	}
 
-	if (macoff + snaplen > po->rx_ring.frame_size) {
+	if (po->tp_version <= TPACKET_V2 &&
+	    macoff + snaplen > po->rx_ring.frame_size) {
 		if (po->copy_thresh &&
 		    atomic_read(&sk->sk_rmem_alloc) + skb->truesize <
 		    (unsigned)sk->sk_rcvbuf) {
@@ -743,19 +1304,31 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 		snaplen = po->rx_ring.frame_size - macoff;
 		if ((int)snaplen < 0)
 			snaplen = 0;
+	} else if (po->tp_version == TPACKET_V3 &&
+		   macoff + snaplen > po->rx_ring.prb_bdqc.max_frame_len) {
+		snaplen = po->rx_ring.prb_bdqc.max_frame_len - macoff;
+		if ((int)snaplen < 0)
+			snaplen = 0;
 	}
 
 	spin_lock(&sk->sk_receive_queue.lock);
-	h.raw = packet_current_frame(po, &po->rx_ring, TP_STATUS_KERNEL);
-	if (!h.raw)
-		goto ring_is_full;
-	packet_increment_head(&po->rx_ring);
-	po->stats.tp_packets++;
+	if (po->tp_version <= TPACKET_V2) {
+		h.raw = packet_current_frame(po, &po->rx_ring,
+					     TP_STATUS_KERNEL);
+		if (!h.raw)
+			goto ring_is_full;
+		packet_increment_head(&po->rx_ring);
+	} else {
+		h.raw = __packet_lookup_frame_in_block(po, macoff + snaplen);
+		if (!h.raw)
+			goto ring_is_full;
+	}
+	po->stats.stats1.tp_packets++;
 	if (copy_skb) {
 		status |= TP_STATUS_COPY;
 		__skb_queue_tail(&sk->sk_receive_queue, copy_skb);
 	}
-	if (!po->stats.tp_drops)
+	if (!po->stats.stats1.tp_drops)
 		status &= ~TP_STATUS_LOSING;
 	spin_unlock(&sk->sk_receive_queue.lock);
 
@@ -801,6 +1374,33 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 		h.h2->tp_vlan_tci = vlan_tx_tag_get(skb);
 		hdrlen = sizeof(*h.h2);
 		break;
+	case TPACKET_V3:
+		/* tp_next_offset was set when the frame was reserved */
+		h.h3->tp_status = status;
+		h.h3->tp_len = skb->len;
+		h.h3->tp_snaplen = snaplen;
+		h.h3->tp_mac = macoff;
+		h.h3->tp_net = netoff;
+		if ((po->tp_tstamp & SOF_TIMESTAMPING_SYS_HARDWARE)
+				&& shhwtstamps->syststamp.tv64)
+			ts = ktime_to_timespec(shhwtstamps->syststamp);
+		else if ((po->tp_tstamp & SOF_TIMESTAMPING_RAW_HARDWARE)
+				&& shhwtstamps->hwtstamp.tv64)
+			ts = ktime_to_timespec(shhwtstamps->hwtstamp);
+		else if (skb->tstamp.tv64)
+			ts = ktime_to_timespec(skb->tstamp);
+		else
+			getnstimeofday(&ts);
+		h.h3->tp_sec = ts.tv_sec;
+		h.h3->tp_nsec = ts.tv_nsec;
+		if (po->rx_ring.prb_bdqc.feature_req_word &
+		    TP_FT_REQ_FILL_RXHASH)
+			h.h3->hv1.tp_rxhash = skb_get_rxhash(skb);
+		else
+			h.h3->hv1.tp_rxhash = 0;
+		h.h3->hv1.tp_vlan_tci = vlan_tx_tag_get(skb);
+		hdrlen = sizeof(*h.h3);
+		break;
 	default:
 		BUG();
 	}
@@ -816,6 +1416,15 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	else
 		sll->sll_ifindex = dev->ifindex;
 
+	/*
+	 * V3 frames are published together with their block, see
+	 * prb_close_block().
+	 */
+	if (po->tp_version == TPACKET_V3) {
+		prb_clear_blk_fill_status(&po->rx_ring);
+		goto drop_n_restore;
+	}
+
 	__packet_set_status(po, h.raw, status);
 	smp_mb();
 #if ARCH_IMPLEMENTS_FLUSH_DCACHE_PAGE == 1
@@ -840,7 +1449,7 @@ drop:
 	return 0;
 
 ring_is_full:
-	po->stats.tp_drops++;
+	po->stats.stats1.tp_drops++;
 	spin_unlock(&sk->sk_receive_queue.lock);
 
 	sk->sk_data_ready(sk, 0);
@@ -1314,7 +1923,7 @@ static int packet_release(struct socket *sock)
 	struct sock *sk = sock->sk;
 	struct packet_sock *po;
 	struct net *net;
-	struct tpacket_req req;
+	union tpacket_req_u req_u;
 
 	if (!sk)
 		return 0;
@@ -1328,28 +1937,24 @@ static int packet_release(struct socket *sock)
 	spin_unlock_bh(&net->packet.sklist_lock);
 
 	spin_lock(&po->bind_lock);
-	if (po->running) {
-		/*
-		 * Remove from protocol table
-		 */
-		po->running = 0;
-		po->num = 0;
-		__dev_remove_pack(&po->prot_hook);
-		__sock_put(sk);
-	}
+	unregister_prot_hook(sk, false);
+	po->num = 0;
 	spin_unlock(&po->bind_lock);
 
 	packet_flush_mclist(sk);
 
-	memset(&req, 0, sizeof(req));
+	memset(&req_u, 0, sizeof(req_u));
 
 	if (po->rx_ring.pg_vec)
-		packet_set_ring(sk, &req, 1, 0);
+		packet_set_ring(sk, &req_u, 1, 0);
 
 	if (po->tx_ring.pg_vec)
-		packet_set_ring(sk, &req, 1, 1);
+		packet_set_ring(sk, &req_u, 1, 1);
 
 	synchronize_net();
+
+	fanout_release(sk);
+
 	/*
 	 *	Now the socket is dead. No more input will appear.
 	 */
@@ -1372,6 +1977,10 @@ static int packet_release(struct socket *sock)
 static int packet_do_bind(struct sock *sk, struct net_device *dev, __be16 protocol)
 {
 	struct packet_sock *po = pkt_sk(sk);
+
+	if (po->fanout)
+		return -EINVAL;
+
 	/*
 	 *	Detach an existing hook if present.
 	 */
@@ -1379,15 +1988,7 @@ static int packet_do_bind(struct sock *sk, struct net_device *dev, __be16 protoc
 	lock_sock(sk);
 
 	spin_lock(&po->bind_lock);
-	if (po->running) {
-		__sock_put(sk);
-		po->running = 0;
-		po->num = 0;
-		spin_unlock(&po->bind_lock);
-		dev_remove_pack(&po->prot_hook);
-		spin_lock(&po->bind_lock);
-	}
-
+	unregister_prot_hook(sk, true);
 	po->num = protocol;
 	po->prot_hook.type = protocol;
 	po->prot_hook.dev = dev;
@@ -1398,9 +1999,7 @@ static int packet_do_bind(struct sock *sk, struct net_device *dev, __be16 protoc
 		goto out_unlock;
 
 	if (!dev || (dev->flags & IFF_UP)) {
-		dev_add_pack(&po->prot_hook);
-		sock_hold(sk);
-		po->running = 1;
+		register_prot_hook(sk);
 	} else {
 		sk->sk_err = ENETDOWN;
 		if (!sock_flag(sk, SOCK_DEAD))
@@ -1531,9 +2130,7 @@ static int packet_create(struct net *net, struct socket *sock, int protocol,
 
 	if (proto) {
 		po->prot_hook.type = proto;
-		dev_add_pack(&po->prot_hook);
-		sock_hold(sk);
-		po->running = 1;
+		register_prot_hook(sk);
 	}
 
 	spin_lock_bh(&net->packet.sklist_lock);
@@ -1972,15 +2569,27 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 	case PACKET_RX_RING:
 	case PACKET_TX_RING:
 	{
-		struct tpacket_req req;
+		union tpacket_req_u req_u;
+		int len;
 
-		if (optlen < sizeof(req))
+		switch (po->tp_version) {
+		case TPACKET_V1:
+		case TPACKET_V2:
+			len = sizeof(req_u.req);
+			break;
+		case TPACKET_V3:
+		default:
+			len = sizeof(req_u.req3);
+			break;
+		}
+		if (optlen < len)
 			return -EINVAL;
 		if (pkt_sk(sk)->has_vnet_hdr)
 			return -EINVAL;
-		if (copy_from_user(&req, optval, sizeof(req)))
+		if (copy_from_user(&req_u, optval, len))
 			return -EFAULT;
-		return packet_set_ring(sk, &req, 0, optname == PACKET_TX_RING);
+		return packet_set_ring(sk, &req_u, 0,
+				       optname == PACKET_TX_RING);
 	}
 	case PACKET_COPY_THRESH:
 	{
@@ -2007,6 +2616,7 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 		switch (val) {
 		case TPACKET_V1:
 		case TPACKET_V2:
+		case TPACKET_V3:
 			po->tp_version = val;
 			return 0;
 		default:
@@ -2091,6 +2701,17 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 		po->tp_tstamp = val;
 		return 0;
 	}
+	case PACKET_FANOUT:
+	{
+		int val;
+
+		if (optlen != sizeof(val))
+			return -EINVAL;
+		if (copy_from_user(&val, optval, sizeof(val)))
+			return -EFAULT;
+
+		return fanout_add(sk, val & 0xffff, val >> 16);
+	}
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -2104,7 +2725,7 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 	struct sock *sk = sock->sk;
 	struct packet_sock *po = pkt_sk(sk);
 	void *data;
-	struct tpacket_stats st;
+	union tpacket_stats_u st;
 
 	if (level != SOL_PACKET)
 		return -ENOPROTOOPT;
@@ -2117,15 +2738,21 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 
 	switch (optname) {
 	case PACKET_STATISTICS:
-		if (len > sizeof(struct tpacket_stats))
-			len = sizeof(struct tpacket_stats);
 		spin_lock_bh(&sk->sk_receive_queue.lock);
 		st = po->stats;
 		memset(&po->stats, 0, sizeof(st));
 		spin_unlock_bh(&sk->sk_receive_queue.lock);
-		st.tp_packets += st.tp_drops;
-
-		data = &st;
+		if (po->tp_version == TPACKET_V3) {
+			if (len > sizeof(struct tpacket_stats_v3))
+				len = sizeof(struct tpacket_stats_v3);
+			st.stats3.tp_packets += st.stats3.tp_drops;
+			data = &st.stats3;
+		} else {
+			if (len > sizeof(struct tpacket_stats))
+				len = sizeof(struct tpacket_stats);
+			st.stats1.tp_packets += st.stats1.tp_drops;
+			data = &st.stats1;
+		}
 		break;
 	case PACKET_AUXDATA:
 		if (len > sizeof(int))
@@ -2166,6 +2793,9 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 		case TPACKET_V2:
 			val = sizeof(struct tpacket2_hdr);
 			break;
+		case TPACKET_V3:
+			val = sizeof(struct tpacket3_hdr);
+			break;
 		default:
 			return -EINVAL;
 		}
@@ -2189,6 +2819,15 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 		val = po->tp_tstamp;
 		data = &val;
 		break;
+	case PACKET_FANOUT:
+		if (len > sizeof(int))
+			len = sizeof(int);
+		val = (po->fanout ?
+		       ((u32)po->fanout->id |
+			((u32)po->fanout->type << 16)) :
+		       0);
+		data = &val;
+		break;
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -2222,9 +2861,7 @@ static int packet_notifier(struct notifier_block *this, unsigned long msg, void
 			if (dev->ifindex == po->ifindex) {
 				spin_lock(&po->bind_lock);
 				if (po->running) {
-					__dev_remove_pack(&po->prot_hook);
-					__sock_put(sk);
-					po->running = 0;
+					__unregister_prot_hook(sk, false);
 					sk->sk_err = ENETDOWN;
 					if (!sock_flag(sk, SOCK_DEAD))
 						sk->sk_error_report(sk);
@@ -2239,11 +2876,8 @@ static int packet_notifier(struct notifier_block *this, unsigned long msg, void
 		case NETDEV_UP:
 			if (dev->ifindex == po->ifindex) {
 				spin_lock(&po->bind_lock);
-				if (po->num && !po->running) {
-					dev_add_pack(&po->prot_hook);
-					sock_hold(sk);
-					po->running = 1;
-				}
+				if (po->num)
+					register_prot_hook(sk);
 				spin_unlock(&po->bind_lock);
 			}
 			break;
@@ -2315,7 +2949,13 @@ static unsigned int packet_poll(struct file *file, struct socket *sock,
 	unsigned int mask = datagram_poll(file, sock, wait);
 
 	spin_lock_bh(&sk->sk_receive_queue.lock);
-	if (po->rx_ring.pg_vec) {
+	if (po->rx_ring.pg_vec && po->tp_version == TPACKET_V3) {
+		struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
+
+		if (prb_block_status(prb_block(pkc, prb_prev_blk_num(pkc))) !=
+		    TP_STATUS_KERNEL)
+			mask |= POLLIN | POLLRDNORM;
+	} else if (po->rx_ring.pg_vec) {
 		if (!packet_previous_frame(po, &po->rx_ring, TP_STATUS_KERNEL))
 			mask |= POLLIN | POLLRDNORM;
 	}
@@ -2435,9 +3075,10 @@ out_free_pgvec:
 	goto out;
 }
 
-static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
+static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 		int closing, int tx_ring)
 {
+	struct tpacket_req *req = &req_u->req;
 	struct pgv *pg_vec = NULL;
 	struct packet_sock *po = pkt_sk(sk);
 	int was_running, order = 0;
@@ -2470,6 +3111,9 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 		case TPACKET_V2:
 			po->tp_hdrlen = TPACKET2_HDRLEN;
 			break;
+		case TPACKET_V3:
+			po->tp_hdrlen = TPACKET3_HDRLEN;
+			break;
 		}
 
 		err = -EINVAL;
@@ -2477,6 +3121,17 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 			goto out;
 		if (unlikely(req->tp_block_size & (PAGE_SIZE - 1)))
 			goto out;
+		if (po->tp_version == TPACKET_V3) {
+			/* Block-based transmit is not supported */
+			if (unlikely(tx_ring))
+				goto out;
+			if (unlikely(req_u->req3.tp_sizeof_priv >=
+				     req->tp_block_size ||
+				     BLK_PLUS_PRIV(req_u->req3.tp_sizeof_priv) +
+				     po->tp_hdrlen + po->tp_reserve >
+				     req->tp_block_size))
+				goto out;
+		}
 		if (unlikely(req->tp_frame_size < po->tp_hdrlen +
 					po->tp_reserve))
 			goto out;
@@ -2510,10 +3165,8 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 	was_running = po->running;
 	num = po->num;
 	if (was_running) {
-		__dev_remove_pack(&po->prot_hook);
 		po->num = 0;
-		po->running = 0;
-		__sock_put(sk);
+		__unregister_prot_hook(sk, false);
 	}
 	spin_unlock(&po->bind_lock);
 
@@ -2523,6 +3176,8 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 	mutex_lock(&po->pg_vec_lock);
 	if (closing || atomic_read(&po->mapped) == 0) {
 		err = 0;
+		if (po->tp_version == TPACKET_V3 && !tx_ring && rb->pg_vec)
+			prb_shutdown_retire_blk_timer(po, rb_queue);
 		spin_lock_bh(&rb_queue->lock);
 		swap(rb->pg_vec, pg_vec);
 		rb->frame_max = (req->tp_frame_nr - 1);
@@ -2530,6 +3185,9 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 		rb->frame_size = req->tp_frame_size;
 		spin_unlock_bh(&rb_queue->lock);
 
+		if (po->tp_version == TPACKET_V3 && !tx_ring && rb->pg_vec)
+			init_prb_bdqc(po, rb, &req_u->req3);
+
 		swap(rb->pg_vec_order, order);
 		swap(rb->pg_vec_len, req->tp_block_nr);
 
@@ -2544,11 +3202,9 @@ static int packet_set_ring(struct sock *sk, struct tpacket_req *req,
 	mutex_unlock(&po->pg_vec_lock);
 
 	spin_lock(&po->bind_lock);
-	if (was_running && !po->running) {
-		sock_hold(sk);
-		po->running = 1;
+	if (was_running) {
 		po->num = num;
-		dev_add_pack(&po->prot_hook);
+		register_prot_hook(sk);
 	}
 	spin_unlock(&po->bind_lock);
 
@@ -0,0 +1,197 @@
+/*
+ *
+ * aio-submit.c
+ *
+ * submit: Benchmark for io_submit() from many threads on one aio context
+ *
+ * Threads of one process share an aio context and each repeatedly submit
+ * a single read of a cached file and reap its completion, so they all
+ * take and drop references to the same kioctx.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <linux/aio_abi.h>
+
+#define AIO_BLOCK_SIZE	4096
+
+static unsigned int nr_threads = 32;
+static unsigned int loops = 100000;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nr_threads,
+		     "Specify number of threads (default: 32)"),
+	OPT_UINTEGER('l', "loop", &loops,
+		     "Specify number of io_submit() calls per thread"),
+	OPT_END()
+};
+
+static const char * const bench_aio_submit_usage[] = {
+	"perf bench aio submit <options>",
+	NULL
+};
+
+static aio_context_t ctx;
+static int fd;
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static int sys_io_setup(unsigned int nr_events, aio_context_t *ctxp)
+{
+	return syscall(__NR_io_setup, nr_events, ctxp);
+}
+
+static int sys_io_destroy(aio_context_t ctx_id)
+{
+	return syscall(__NR_io_destroy, ctx_id);
+}
+
+static int sys_io_submit(aio_context_t ctx_id, long nr, struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx_id, nr, iocbpp);
+}
+
+static int sys_io_getevents(aio_context_t ctx_id, long min_nr, long nr,
+			    struct io_event *events)
+{
+	return syscall(__NR_io_getevents, ctx_id, min_nr, nr, events, NULL);
+}
+
+static void *worker(void *arg __used)
+{
+	char buf[AIO_BLOCK_SIZE];
+	struct iocb iocb, *iocbp = &iocb;
+	struct io_event event;
+	unsigned int i;
+
+	memset(&iocb, 0, sizeof(iocb));
+	iocb.aio_lio_opcode = IOCB_CMD_PREAD;
+	iocb.aio_fildes = fd;
+	iocb.aio_buf = (unsigned long)buf;
+	iocb.aio_nbytes = sizeof(buf);
+
+	for (i = 0; i < loops; i++) {
+		if (sys_io_submit(ctx, 1, &iocbp) != 1)
+			barf("io_submit");
+		if (sys_io_getevents(ctx, 1, 1, &event) != 1)
+			barf("io_getevents");
+		if (event.res != sizeof(buf)) {
+			errno = -event.res;
+			barf("aio read");
+		}
+	}
+
+	return NULL;
+}
+
+static void setup_file(void)
+{
+	char name[] = "/tmp/perf-bench-aio-XXXXXX";
+	char buf[AIO_BLOCK_SIZE];
+
+	fd = mkstemp(name);
+	if (fd < 0)
+		barf("mkstemp");
+	unlink(name);
+
+	/* the reads are served from the page cache */
+	memset(buf, 0, sizeof(buf));
+	if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+		barf("write");
+}
+
+int bench_aio_submit(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, nr_ops;
+	pthread_t *threads;
+	unsigned int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_aio_submit_usage, 0);
+
+	if (!nr_threads)
+		nr_threads = 1;
+
+	setup_file();
+
+	ctx = 0;
+	if (sys_io_setup(nr_threads, &ctx))
+		barf("io_setup");
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		barf("calloc");
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i], NULL, worker, NULL))
+			barf("pthread_create");
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	free(threads);
+	sys_io_destroy(ctx);
+	close(fd);
+
+	/* an op is one io_submit() and the io_getevents() reaping it */
+	nr_ops = (unsigned long long)nr_threads * loops;
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+	if (!result_usec)
+		result_usec = 1;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads doing %u io_submit() calls each "
+		       "on one aio context\n\n",
+		       nr_threads, loops);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec / (double)nr_ops);
+		printf(" %14llu ops/sec\n",
+		       nr_ops * 1000000ULL / result_usec);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ *
+ * locking-rwsem.c
+ *
+ * rwsem: Benchmark for contended kernel rw_semaphores
+ *
+ * Threads of one process repeatedly mmap() and munmap() an anonymous
+ * area and fault in its pages, so they all contend on the mm's mmap_sem:
+ * mmap()/munmap() take it for writing, page faults take it for reading.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+static unsigned int nr_threads;
+static unsigned int loops = 10000;
+static unsigned int nr_pages = 4;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nr_threads,
+		     "Specify number of threads (default: number of cpus)"),
+	OPT_UINTEGER('l', "loop", &loops,
+		     "Specify number of loops per thread"),
+	OPT_UINTEGER('p', "pages", &nr_pages,
+		     "Specify number of pages faulted in per mapping"),
+	OPT_END()
+};
+
+static const char * const bench_locking_rwsem_usage[] = {
+	"perf bench locking rwsem <options>",
+	NULL
+};
+
+static void barf(const char *msg)
+{
+	fprintf(stderr, "%s (error: %s)\n", msg, strerror(errno));
+	exit(1);
+}
+
+static void *worker(void *arg __used)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t len = nr_pages * page_size;
+	unsigned int i, j;
+	char *p;
+
+	for (i = 0; i < loops; i++) {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			barf("mmap");
+
+		for (j = 0; j < nr_pages; j++)
+			p[j * page_size] = 1;
+
+		if (munmap(p, len))
+			barf("munmap");
+	}
+
+	return NULL;
+}
+
+int bench_locking_rwsem(int argc, const char **argv,
+			const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, nr_ops;
+	pthread_t *threads;
+	unsigned int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_locking_rwsem_usage, 0);
+
+	if (!nr_threads)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		barf("calloc");
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i], NULL, worker, NULL))
+			barf("pthread_create");
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	free(threads);
+
+	/* every loop is one mmap() and one munmap() */
+	nr_ops = (unsigned long long)nr_threads * loops * 2;
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+	if (!result_usec)
+		result_usec = 1;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads doing %u mmap/munmap loops each, "
+		       "faulting %u pages per mapping\n\n",
+		       nr_threads, loops, nr_pages);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec / (double)nr_ops);
+		printf(" %14llu ops/sec\n",
+		       nr_ops * 1000000ULL / result_usec);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -13,6 +13,8 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  locking ... kernel locking primitives under contention
+ *  aio   ... asynchronous I/O submission
  *
  */
 
@@ -58,6 +60,26 @@ static struct bench_suite mem_suites[] = {
 	  NULL             }
 };
 
+static struct bench_suite locking_suites[] = {
+	{ "rwsem",
+	  "Threads contending on mmap_sem through mmap() and page faults",
+	  bench_locking_rwsem },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL                }
+};
+
+static struct bench_suite aio_suites[] = {
+	{ "submit",
+	  "Threads submitting reads through one aio context",
+	  bench_aio_submit },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -71,6 +93,12 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "locking",
+	  "kernel locking primitives",
+	  locking_suites },
+	{ "aio",
+	  "asynchronous I/O submission",
+	  aio_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },